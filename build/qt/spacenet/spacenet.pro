@@ -15,7 +15,22 @@ SOURCES += \
     ../../../src/tracker.cpp \
     ../../../tests/tracker_test.cpp \
     ../../../tests/rand_test.cpp \
-    ../../../tests/all_tests.cpp
+    ../../../tests/all_tests.cpp \
+    ../../../src/parallel_reader.cpp \
+    ../../../tests/parallel_reader_test.cpp \
+    ../../../src/uring.cpp \
+    ../../../tests/reader_bench.cpp \
+    ../../../src/matcher.cpp \
+    ../../../tests/matcher_test.cpp \
+    ../../../src/watcher.cpp \
+    ../../../tests/watcher_test.cpp \
+    ../../../src/mounts.cpp \
+    ../../../tests/mounts_test.cpp \
+    ../../../tests/bounded_queue_test.cpp \
+    ../../../src/block_reader.cpp \
+    ../../../tests/block_reader_test.cpp \
+    ../../../src/chunker.cpp \
+    ../../../tests/chunker_test.cpp
 
 RESOURCES += qml.qrc
 
@@ -43,7 +58,15 @@ HEADERS += \
     ../../../include/sqlite/sqlite3.h \
     ../../../include/sqlite/sqlite3ext.h \
     ../../../include/tracker.hpp \
-    ../../../include/rand.hpp
+    ../../../include/rand.hpp \
+    ../../../include/parallel_reader.hpp \
+    ../../../include/uring.hpp \
+    ../../../include/matcher.hpp \
+    ../../../include/watcher.hpp \
+    ../../../include/mounts.hpp \
+    ../../../include/bounded_queue.hpp \
+    ../../../include/block_reader.hpp \
+    ../../../include/chunker.hpp
 
 INCLUDEPATH += .
 INCLUDEPATH += ../../../include
@@ -0,0 +1,247 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#ifndef BLOCK_READER_HPP_INCLUDED
+#define BLOCK_READER_HPP_INCLUDED
+//------------------------------------------------------------------------------
+#pragma once
+//------------------------------------------------------------------------------
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "locale_traits.hpp"
+#include "uring.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+//------------------------------------------------------------------------------
+// Reads file by blocks of block_size_ bytes for hashing, the last block is
+// padded with zeros. Adjacent blocks are handed out by runs, so they may be
+// hashed by several at once. Large files may be read from memory mapping,
+// blocks are then handed out right from the mapping without copying.
+//------------------------------------------------------------------------------
+class block_reader {
+    private:
+        std::vector<uint8_t> buf_;
+        // read_size_ bytes aligned on page boundary are somewhere inside
+        std::vector<uint8_t> large_;
+
+        bool read_stream(
+            int fd,
+            bool (* on_blocks)(void * context, const uint8_t * blocks, size_t count),
+            void * context);
+        bool deliver(
+            const uint8_t * data,
+            size_t size,
+            bool (* on_blocks)(void * context, const uint8_t * blocks, size_t count),
+            void * context);
+
+        bool read_large(
+            int fd,
+            bool (* on_blocks)(void * context, const uint8_t * blocks, size_t count),
+            void * context);
+#if __linux__
+        bool read_mapped(
+            int fd,
+            uint64_t file_size,
+            bool (* on_blocks)(void * context, const uint8_t * blocks, size_t count),
+            void * context);
+#endif
+        template <typename Block>
+        bool split(const uint8_t * blocks, size_t count, Block & on_block) const {
+            for( size_t i = 0; i < count; i++ )
+                if( !on_block(blocks + i * block_size_) )
+                    return false;
+
+            return true;
+        }
+    protected:
+    public:
+        size_t block_size_ = 4096;
+
+        // Linux only, regular files of at least this size are mapped into
+        // memory by windows of mmap_window_ bytes, zero disables. Window is
+        // clamped to the current file size, if file is truncated while its
+        // window is hashed, read fails instead of SIGBUS by handler installed
+        // on first mapped read
+        uint64_t mmap_threshold_ = 0;
+        size_t mmap_window_ = sizeof(void *) >= 8 ? 256 * 1024 * 1024 : 16 * 1024 * 1024;
+
+        // if nonzero, file is read by this many bytes at once (rounded to
+        // multiple of block and page size) into page aligned buffer, memory
+        // mapping isn't used then
+        size_t read_size_ = 0;
+        // Linux only, with read_size_ file is read bypassing page cache
+        // (O_DIRECT) if its filesystem supports it
+        bool direct_io_ = false;
+        // Linux only, with read_size_ pages of ranges already hashed are
+        // dropped from page cache (POSIX_FADV_DONTNEED)
+        bool drop_cache_ = false;
+
+        // file is read from this offset, multiple of block size, blocks
+        // before it are counted by blocks_ and bytes_ as if they were read
+        uint64_t offset_ = 0;
+
+        // number of blocks delivered by the last read, run being delivered
+        // is already counted
+        uint64_t blocks_ = 0;
+        // number of bytes of file delivered by the last read, padding of the
+        // last block isn't counted, run being delivered is already counted
+        uint64_t bytes_ = 0;
+
+        // calls on_blocks(const uint8_t * blocks, size_t count) for runs of
+        // count adjacent blocks, stops if it returns false, returns false if
+        // file can't be opened or read or reading is stopped
+        template <typename Blocks>
+        bool read_runs(const string & path_name, Blocks & on_blocks) {
+            return read(path_name, [] (void * context, const uint8_t * blocks, size_t count) {
+                return (*static_cast<Blocks *>(context))(blocks, count);
+            }, &on_blocks);
+        }
+
+        // calls on_block(const uint8_t * block) for every block
+        template <typename Block>
+        bool read(const string & path_name, Block & on_block) {
+            auto on_blocks = [&] (const uint8_t * blocks, size_t count) {
+                return split(blocks, count, on_block);
+            };
+
+            return read_runs(path_name, on_blocks);
+        }
+
+        bool read(
+            const string & path_name,
+            bool (* on_blocks)(void * context, const uint8_t * blocks, size_t count),
+            void * context);
+
+        // splits file content already in memory into blocks, offset_ isn't
+        // used
+        template <typename Blocks>
+        bool read_runs(const uint8_t * data, size_t size, Blocks & on_blocks) {
+            return read(data, size, [] (void * context, const uint8_t * blocks, size_t count) {
+                return (*static_cast<Blocks *>(context))(blocks, count);
+            }, &on_blocks);
+        }
+
+        template <typename Block>
+        bool read(const uint8_t * data, size_t size, Block & on_block) {
+            auto on_blocks = [&] (const uint8_t * blocks, size_t count) {
+                return split(blocks, count, on_block);
+            };
+
+            return read_runs(data, size, on_blocks);
+        }
+
+        bool read(
+            const uint8_t * data,
+            size_t size,
+            bool (* on_blocks)(void * context, const uint8_t * blocks, size_t count),
+            void * context);
+
+        // Linux only, starts asynchronous read ahead of the first read_size_
+        // bytes of file to be read next, does nothing with direct_io_
+        void prefetch(const string & path_name) const;
+};
+//------------------------------------------------------------------------------
+#if HAVE_IO_URING
+//------------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+//------------------------------------------------------------------------------
+// Reads whole small files with io_uring, up to depth files are being opened,
+// read or closed at once, so latency of every file is hidden behind the rest.
+// Contents are read into buffers registered with kernel if RLIMIT_MEMLOCK
+// allows it. Not thread safe, every thread must own its reader.
+//------------------------------------------------------------------------------
+class uring_file_reader {
+    private:
+        struct slot {
+            int fd = -1;
+            // index in files_
+            size_t file = 0;
+            int state = 0;
+        };
+
+        std::unique_ptr<io_uring_queue> queue_;
+        size_t file_size_;
+        std::vector<uint8_t> buffers_;
+        uint8_t * base_ = nullptr;
+        std::vector<slot> slots_;
+        bool fixed_ = false;
+        std::vector<std::pair<string, uint64_t>> files_;
+
+        void run(
+            void (* on_file)(void * context, uint64_t tag, const uint8_t * data, size_t size),
+            void * context);
+    protected:
+    public:
+        // throws std::runtime_error if io_uring isn't available, files of less
+        // than file_size bytes rounded up to page size are read
+        uring_file_reader(unsigned depth, size_t file_size);
+
+        const auto & file_size() const {
+            return file_size_;
+        }
+
+        size_t depth() const {
+            return slots_.size();
+        }
+
+        // files added and not read yet
+        size_t size() const {
+            return files_.size();
+        }
+
+        void add(const string & path_name, uint64_t tag) {
+            files_.emplace_back(path_name, tag);
+        }
+
+        // reads added files and calls on_file(tag, data, size) for every one,
+        // data is valid only during the call, it is nullptr if file can't be
+        // read by this engine (error, file isn't small anymore, unsupported
+        // operation), caller reads it conventionally then
+        template <typename File>
+        void run(File & on_file) {
+            run([] (void * context, uint64_t tag, const uint8_t * data, size_t size) {
+                (*static_cast<File *>(context))(tag, data, size);
+            }, &on_file);
+        }
+};
+//------------------------------------------------------------------------------
+#endif
+//------------------------------------------------------------------------------
+namespace tests {
+//------------------------------------------------------------------------------
+void block_reader_test();
+//------------------------------------------------------------------------------
+} // namespace tests
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
+#endif // BLOCK_READER_HPP_INCLUDED
+//------------------------------------------------------------------------------
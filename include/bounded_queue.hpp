@@ -0,0 +1,154 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#ifndef BOUNDED_QUEUE_HPP_INCLUDED
+#define BOUNDED_QUEUE_HPP_INCLUDED
+//------------------------------------------------------------------------------
+#pragma once
+//------------------------------------------------------------------------------
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+//------------------------------------------------------------------------------
+// Bounded multi producer multi consumer lock free queue, D. Vyukov's
+// algorithm, capacity is rounded up to power of two. Full queue rejects
+// push, that is the backpressure for producers.
+//------------------------------------------------------------------------------
+template <typename T>
+class bounded_queue {
+    private:
+        struct cell {
+            std::atomic<size_t> sequence;
+            T data;
+        };
+
+        std::unique_ptr<cell[]> buffer_;
+        size_t mask_;
+        alignas(64) std::atomic<size_t> enqueue_pos_;
+        alignas(64) std::atomic<size_t> dequeue_pos_;
+    protected:
+    public:
+        explicit bounded_queue(size_t capacity) : enqueue_pos_(0), dequeue_pos_(0) {
+            size_t size = 2;
+
+            while( size < capacity )
+                size <<= 1;
+
+            buffer_.reset(new cell[size]);
+            mask_ = size - 1;
+
+            for( size_t i = 0; i < size; i++ )
+                buffer_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        bounded_queue(const bounded_queue &) = delete;
+        void operator = (const bounded_queue &) = delete;
+
+        bool try_push(T & v) {
+            cell * c;
+            auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+
+            for(;;) {
+                c = &buffer_[pos & mask_];
+                auto seq = c->sequence.load(std::memory_order_acquire);
+                auto dif = intptr_t(seq) - intptr_t(pos);
+
+                if( dif == 0 ) {
+                    if( enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed) )
+                        break;
+                }
+                else if( dif < 0 )
+                    return false;
+                else
+                    pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+
+            c->data = std::move(v);
+            c->sequence.store(pos + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        bool try_pop(T & v) {
+            cell * c;
+            auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+
+            for(;;) {
+                c = &buffer_[pos & mask_];
+                auto seq = c->sequence.load(std::memory_order_acquire);
+                auto dif = intptr_t(seq) - intptr_t(pos + 1);
+
+                if( dif == 0 ) {
+                    if( dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed) )
+                        break;
+                }
+                else if( dif < 0 )
+                    return false;
+                else
+                    pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+
+            v = std::move(c->data);
+            c->sequence.store(pos + mask_ + 1, std::memory_order_release);
+
+            return true;
+        }
+};
+//------------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+//------------------------------------------------------------------------------
+// Backoff of thread waiting on queue, spins with yield first, then sleeps.
+//------------------------------------------------------------------------------
+struct backoff {
+    uintptr_t idle = 0;
+
+    void reset() {
+        idle = 0;
+    }
+
+    void operator () () {
+        if( ++idle < 64 )
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+};
+//------------------------------------------------------------------------------
+namespace tests {
+//------------------------------------------------------------------------------
+void bounded_queue_test();
+//------------------------------------------------------------------------------
+} // namespace tests
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
+#endif // BOUNDED_QUEUE_HPP_INCLUDED
+//------------------------------------------------------------------------------
@@ -29,6 +29,7 @@
 //------------------------------------------------------------------------------
 #include <cinttypes>
 #include <cstdint>
+#include <vector>
 //------------------------------------------------------------------------------
 #include "config.h"
 #include "locale_traits.hpp"
@@ -151,6 +152,29 @@ struct cdc512 : public cdc512_data {
     void update(const void * data, uintptr_t size);
     void finish();
 
+    // running state (a..h and p big endian) to continue hashing later, data
+    // hashed so far must be fed by multiples of 64 bytes for that, load
+    // returns false if state is malformed or not of hashed bytes, of blocks
+    // of another size for example
+    static constexpr size_t state_size = 9 * sizeof(uint64_t);
+
+    void save(uint8_t * state) const;
+    bool load(const uint8_t * state, size_t size, uint64_t hashed);
+
+    // digests of n equal sized buffers at once, digests must have room for
+    // n * sizeof(digest) bytes, result is the same as cdc512(data[i], data[i] + size)
+    static void hash_many(const uint8_t * const * data, size_t n, uintptr_t size, uint8_t * digests);
+
+    // names of multi buffer kernels of hash_many supported by CPU, the widest
+    // first and "generic" the last, the widest one is selected at first use
+    // unless CDC512_KERNEL environment variable names another one, remainder
+    // of buffers is hashed by narrower kernels, single stream hashing is
+    // always scalar and isn't affected
+    static std::vector<const char *> kernels();
+    static const char * kernel();
+    // returns false if kernel is unknown or unsupported
+    static bool kernel(const char * name);
+
     template <typename Container>
     void finish(Container & c) {
         finish();
@@ -181,6 +205,55 @@ struct cdc512 : public cdc512_data {
     std::string to_short_string() const;
 };
 //------------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+//------------------------------------------------------------------------------
+// Merkle tree over block digests, node digest is cdc512 of concatenated
+// digests of children, left child of node with n leaves holds the largest
+// power of two leaves less than n. Leaves are added in order, only roots of
+// complete subtrees are kept, so memory is O(log n) and runs of blocks
+// aligned on power of two may be hashed into subtrees independently.
+//------------------------------------------------------------------------------
+class cdc512_tree {
+    private:
+        struct node {
+            uint64_t leaves;
+            uint8_t digest[sizeof(cdc512_data)];
+        };
+
+        std::vector<node> stack_;
+        uint64_t leaves_ = 0;
+
+        static void join(node & left, const node & right);
+    protected:
+    public:
+        void init() {
+            stack_.clear();
+            leaves_ = 0;
+        }
+
+        const auto & leaves() const {
+            return leaves_;
+        }
+
+        // leaf is digest of sizeof(cdc512_data) bytes
+        void add(const uint8_t * leaf);
+
+        // root digest bound with number of leaves, of empty tree too
+        void finish(uint8_t * digest);
+
+        // roots of complete subtrees to continue adding leaves later, load
+        // returns false if state is malformed
+        void save(std::vector<uint8_t> & state) const;
+        bool load(const uint8_t * state, size_t size);
+
+        template <typename Container>
+        void finish(Container & c) {
+            uint8_t digest[sizeof(cdc512_data)];
+            finish(digest);
+            c.assign(std::cbegin(digest), std::cend(digest));
+        }
+};
+//------------------------------------------------------------------------------
 namespace tests {
 //------------------------------------------------------------------------------
 void cdc512_test();
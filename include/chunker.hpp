@@ -0,0 +1,96 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#ifndef CHUNKER_HPP_INCLUDED
+#define CHUNKER_HPP_INCLUDED
+//------------------------------------------------------------------------------
+#pragma once
+//------------------------------------------------------------------------------
+#include <cstddef>
+#include <cstdint>
+//------------------------------------------------------------------------------
+#include "config.h"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+//------------------------------------------------------------------------------
+// Content defined chunking (FastCDC): chunk ends where Gear rolling hash of
+// the last 64 bytes has masked bits zero, so boundaries follow content and
+// insertion or deletion shifts only chunks around it. First min_size bytes
+// of chunk aren't hashed at all, before avg_size harder mask is used and
+// easier one after it (normalized chunking), chunk is cut at max_size.
+// Data is scanned as a stream of pieces of any size.
+//------------------------------------------------------------------------------
+class content_chunker {
+    private:
+        size_t min_size_;
+        size_t avg_size_;
+        size_t max_size_;
+        uint64_t mask_small_;
+        uint64_t mask_large_;
+
+        uint64_t hash_ = 0;
+        // bytes of current chunk scanned
+        size_t length_ = 0;
+    protected:
+    public:
+        // zero min_size or max_size are avg_size / 4 and avg_size * 8,
+        // avg_size is rounded down to power of two
+        content_chunker(size_t min_size, size_t avg_size, size_t max_size);
+
+        const auto & min_size() const {
+            return min_size_;
+        }
+
+        const auto & avg_size() const {
+            return avg_size_;
+        }
+
+        const auto & max_size() const {
+            return max_size_;
+        }
+
+        // starts new chunk
+        void reset() {
+            hash_ = 0;
+            length_ = 0;
+        }
+
+        // returns number of leading bytes of data belonging to current chunk,
+        // cut is set if chunk ends after them, next chunk is started then
+        size_t scan(const uint8_t * data, size_t size, bool & cut);
+};
+//------------------------------------------------------------------------------
+namespace tests {
+//------------------------------------------------------------------------------
+void chunker_test();
+//------------------------------------------------------------------------------
+} // namespace tests
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
+#endif // CHUNKER_HPP_INCLUDED
+//------------------------------------------------------------------------------
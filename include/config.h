@@ -36,13 +36,48 @@
 #endif
 //------------------------------------------------------------------------------
 #if !defined(HAVE_READDIR_R)
-#   if defined(__GNUC_PREREQ)
+#   if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 24))
+// deprecated, readdir is thread safe on distinct directory streams
+#       define HAVE_READDIR_R 0
+#   elif defined(__GNUC_PREREQ)
 #       if __GNUC_PREREQ (3,2)
 #           define HAVE_READDIR_R (_POSIX_C_SOURCE >= 1 || _XOPEN_SOURCE || _BSD_SOURCE || _SVID_SOURCE || _POSIX_SOURCE)
 #       endif
 #   endif
 #endif
 //------------------------------------------------------------------------------
+#if !defined(HAVE_STATX)
+#   if __linux__ && defined(__GLIBC_PREREQ)
+#       if __GLIBC_PREREQ (2,28)
+#           define HAVE_STATX 1
+#       endif
+#   endif
+#endif
+//------------------------------------------------------------------------------
+#if !defined(HAVE_IO_URING)
+#   if __linux__ && defined(__has_include)
+#       if __has_include(<linux/io_uring.h>)
+#           define HAVE_IO_URING 1
+#       endif
+#   endif
+#endif
+//------------------------------------------------------------------------------
+#if !defined(HAVE_INOTIFY)
+#   if __linux__ && defined(__has_include)
+#       if __has_include(<sys/inotify.h>)
+#           define HAVE_INOTIFY 1
+#       endif
+#   endif
+#endif
+//------------------------------------------------------------------------------
+#if !defined(HAVE_FANOTIFY)
+#   if __linux__ && defined(__has_include)
+#       if __has_include(<sys/fanotify.h>)
+#           define HAVE_FANOTIFY 1
+#       endif
+#   endif
+#endif
+//------------------------------------------------------------------------------
 #if __cplusplus
 //------------------------------------------------------------------------------
 #if _MSC_VER <= 1900 || _X86_ || __x86_64 || _M_X64 || _M_IX86
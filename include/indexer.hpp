@@ -27,19 +27,37 @@
 //------------------------------------------------------------------------------
 #pragma once
 //------------------------------------------------------------------------------
+#if _WIN32
 #include <io.h>
+#else
+#include <unistd.h>
+#endif
 #include <functional>
 #include <string>
 #include <forward_list>
+#include <memory>
+#include <vector>
+#if __linux__
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
 //------------------------------------------------------------------------------
+#include "config.h"
+#include "scope_exit.hpp"
 #include "sqlite/sqlite_modern_cpp.h"
 #include "sqlite3pp/sqlite3pp.h"
 #include "locale_traits.hpp"
+#include "mounts.hpp"
 //------------------------------------------------------------------------------
 namespace spacenet {
 //------------------------------------------------------------------------------
 extern const string::value_type path_delimiter[];
 //------------------------------------------------------------------------------
+#if HAVE_IO_URING
+class io_uring_queue;
+#endif
+struct ignore_list;
+//------------------------------------------------------------------------------
 #if _WIN32 && _MSC_VER
 //------------------------------------------------------------------------------
 #ifndef CLOCK_REALTIME
@@ -82,21 +100,105 @@ string path2rel(const string & path, bool no_back_slash = false);
 //------------------------------------------------------------------------------
 ////////////////////////////////////////////////////////////////////////////////
 //------------------------------------------------------------------------------
+// Entries of one directory as structure of arrays, the same index addresses
+// one entry in every array. Path based engine may split a directory into
+// several batches when it descends into subdirectory in the middle of it.
+//------------------------------------------------------------------------------
+struct directory_batch {
+    enum entry_type : uint8_t {
+        other,
+        regular,
+        directory,
+        symlink
+    };
+
+    string path;
+    uintptr_t level = 0;
+
+    std::vector<string> names;
+    std::vector<uint64_t> sizes;
+    // nanoseconds since 1970-01-01 00:00:00 UTC
+    std::vector<uint64_t> mtimes;
+    std::vector<uint8_t> types;
+
+    size_t size() const {
+        return names.size();
+    }
+
+    void clear();
+};
+//------------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+//------------------------------------------------------------------------------
 struct directory_reader {
     std::function<void()> manipulator_;
+    // if set, called for every subdirectory instead of descending into it,
+    // the subdirectory path is in path_name_ and its level in level_
+    std::function<void()> spawner_;
 
     string path_;
     string path_name_;
     string name_;
+    // globs separated by ';', see name_matcher
     string mask_;
     string exclude_;
     uintptr_t level_ = 0;
+    uintptr_t base_level_ = 0;
     uintptr_t max_level_ = 0;
 
     bool list_dot_ = false;
     bool list_dotdot_ = false;
     bool list_directories_ = false;
     bool recursive_ = false;
+    // mask_ and exclude_ are regular expressions instead of globs
+    bool regex_ = false;
+
+    // name of per directory ignore file in gitignore syntax, empty disables,
+    // ignored directories are pruned and never opened
+    string ignore_file_ = CPPX_U(".spacenetignore");
+    // rules inherited from parents of root_path, parallel reader passes
+    // them to threads reading subtrees
+    std::shared_ptr<const ignore_list> ignore_base_;
+    // rules in effect for the directory being read
+    std::shared_ptr<const ignore_list> ignore_;
+
+    // don't descend into directories on other filesystem than root_dev_
+    bool one_filesystem_ = false;
+    // device to stay on, zero means device of root_path, parallel reader
+    // passes it to threads reading subtrees
+    uint64_t root_dev_ = 0;
+    // mount points whose policy is skip are not descended into, loaded
+    // from /proc/self/mountinfo on read if null, empty table disables it
+    std::shared_ptr<const mount_table> mounts_;
+    // device in effect for the read
+    uint64_t boundary_dev_ = 0;
+    // mount points are looked up by paths under canonical root, used when
+    // root path given differs from it
+    bool remap_root_ = false;
+    string canonical_root_;
+    size_t root_size_ = 0;
+#if __linux__
+    // read directories relative to their descriptors (openat/statx) instead of
+    // resolving full path of every entry, entries of no interest by d_type
+    // and mask are not stat-ed at all
+    bool fd_relative_ = true;
+    // entries of every directory are stat-ed and delivered in ascending inode
+    // order instead of readdir order, less seeks on rotational disks
+    bool inode_order_ = false;
+#if HAVE_STATX
+    // fields requested from statx, zero means entry type is taken from d_type
+    // and no metadata syscall is made for entries
+    unsigned statx_mask_ = STATX_TYPE | STATX_MODE | STATX_UID | STATX_GID | STATX_SIZE
+        | STATX_MTIME | STATX_CTIME | STATX_INO | STATX_NLINK;
+#endif
+#if HAVE_IO_URING && HAVE_STATX
+    // if nonzero, entries of every directory are stat-ed with IORING_OP_STATX
+    // submitted by batches of this depth
+    uintptr_t uring_depth_ = 0;
+    // created on first use, must not be shared between threads
+    std::shared_ptr<io_uring_queue> uring_;
+#endif
+#endif
 
     uint64_t atime = 0;
     uint64_t ctime = 0;
@@ -105,12 +207,33 @@ struct directory_reader {
     uint32_t ctime_ns = 0;
     uint32_t mtime_ns = 0;
     uint64_t fsize = 0;
+    uint32_t mode = 0;
+    uint32_t uid = 0;
+    uint32_t gid = 0;
+    // zero if unknown, on Windows for example
+    uint64_t dev = 0;
+    uint64_t ino = 0;
+    uint32_t nlink = 0;
     bool is_dir = false;
     bool is_reg = false;
     bool is_lnk = false;
 
     bool abort_ = false;
 
+    // descriptor of directory whose entries are being delivered by read_at,
+    // -1 if entries are delivered by path
+    int at_fd_ = -1;
+
+    void (* batch_visitor_)(void * context, const directory_batch & batch) = nullptr;
+    void * batch_context_ = nullptr;
+    directory_batch batch_;
+
+    void deliver();
+    void flush_batch();
+    void prepare(const string & root_path);
+    // current entry is directory which must not be descended into
+    bool mount_boundary() const;
+
     template <typename Manipul>
     void read(const string & root_path, const Manipul & ml) {
         this->manipulator_ = [&] {
@@ -120,7 +243,60 @@ struct directory_reader {
         read(root_path);
     }
 
+    // calls visitor(const directory_batch &) once per directory instead of
+    // manipulator_ per entry, the only indirect call is the per directory one
+    // through batch_visitor_, the trampoline is instantiated for Visitor, so
+    // consumer loop over the arrays is inlined into it, read itself stays
+    // out of line with its platform specific engines
+    template <typename Visitor>
+    void read_batches(const string & root_path, Visitor & visitor) {
+        batch_visitor_ = [] (void * context, const directory_batch & batch) {
+            (*static_cast<Visitor *>(context))(batch);
+        };
+        batch_context_ = &visitor;
+
+        at_scope_exit(
+            batch_visitor_ = nullptr;
+            batch_context_ = nullptr;
+        );
+
+        read(root_path);
+    }
+
     void read(const string & root_path);
+
+    // rules in effect for directory dir_path, parent ones plus its ignore_file_
+    std::shared_ptr<const ignore_list> load_ignore(
+        const string & dir_path,
+        const std::shared_ptr<const ignore_list> & parent) const;
+
+    // check access permissions of current entry, on POSIX systems it is
+    // computed from mode, uid and gid without syscall if they grant access,
+    // otherwise faccessat() decides, so ACLs and capabilities are honored
+    bool accessible(int amode) const;
+#if __linux__
+    void read_at(const string & root_path);
+#endif
+};
+//------------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+//------------------------------------------------------------------------------
+// Record of changes journal written by reindex, seq grows monotonically and
+// is never reused, consumers remember last seen one and catch up from it
+//------------------------------------------------------------------------------
+struct entry_change {
+    enum kind_type : int {
+        created  = 1,
+        modified = 2,   // size or mtime of file changed
+        digested = 3,   // file digest and blocks digests recalculated
+        deleted  = 4
+    };
+
+    uint64_t seq = 0;
+    uint64_t entry_id = 0;
+    uint64_t parent_id = 0;
+    std::string name;   // in UTF-8 as stored in entries
+    kind_type kind = created;
 };
 //------------------------------------------------------------------------------
 ////////////////////////////////////////////////////////////////////////////////
@@ -128,6 +304,89 @@ struct directory_reader {
 class directory_indexer {
     private:
         bool modified_only_ = true;
+        // directories whose stamp (later of mtime and ctime) equals the stored
+        // one are not listed, stored children are trusted and only child
+        // directories are visited, so in place modifications of files in
+        // unchanged directories are not noticed until a full reindex
+        bool incremental_ = false;
+    public:
+        // order in which files of a directory are hashed, for rotational disks
+        enum hash_order_type {
+            readdir_order,
+            // Linux only, files are stat-ed and hashed in ascending inode order
+            inode_order,
+            // Linux only, files are stat-ed in inode order and hashed in order of
+            // physical offset of their first extent (FIEMAP), every directory
+            // is listed before its files are hashed
+            extent_order
+        };
+        // how file digest is calculated, mode is stored with digest, files
+        // whose digest was calculated in other mode are hashed again
+        enum digest_mode_type {
+            // cdc512 of whole file content, blocks padded
+            sequential_digest,
+            // root of Merkle tree of block digests, see cdc512_tree, content
+            // is hashed only once
+            merkle_digest
+        };
+    private:
+        hash_order_type hash_order_ = readdir_order;
+        digest_mode_type digest_mode_ = sequential_digest;
+        // file whose size only grew since it was hashed isn't hashed from the
+        // start, its last full block hashed before is checked and the rest
+        // is hashed on from digest state stored with digest, fixed blocks only
+        bool detect_appends_ = false;
+        // if nonzero, file is split into blocks of the least power of two
+        // size from 4096 up to this one so that it has at most 4096 blocks,
+        // large files then have less block digests, block size is stored
+        // with entry and files of other block size are hashed again, fixed
+        // blocks only
+        size_t max_block_size_ = 0;
+        // if nonzero, content of file of at least this size whose mtime
+        // changed but size didn't is compared with stored block digests of
+        // its first, last and several random blocks, if they are equal digest
+        // is kept and file is queued for full verification, fixed blocks only
+        uint64_t precheck_size_ = 0;
+        // at most this many queued files are verified by every reindex,
+        // files listed by it only, at the end of full pass or after listing
+        // of their directory in dirty mode
+        uintptr_t verify_limit_ = ~uintptr_t(0);
+        // if nonzero, while file is hashed state of its digest is stored
+        // every this many bytes and at shutdown, so interrupted hashing of
+        // file not modified since is resumed from there, fixed blocks only
+        uint64_t checkpoint_size_ = 0;
+        // only this many leading bytes (at most 64) of block digests are
+        // stored, file digests are whole, width is stored with entry and
+        // files of other width are hashed again
+        size_t block_digest_size_ = 64;
+        // if nonzero, digests are of content defined chunks of about this
+        // average size (see content_chunker) instead of fixed blocks, their
+        // offsets and lengths are stored with digests, zero minimal and
+        // maximal sizes are avg / 4 and avg * 8
+        size_t chunk_avg_size_ = 0;
+        size_t chunk_min_size_ = 0;
+        size_t chunk_max_size_ = 0;
+        // number of threads reading and hashing files, database is updated
+        // by calling thread in batched transactions and in full mode
+        // directory tree is traversed by one more thread, zero means files
+        // are hashed by calling thread as they are listed
+        uintptr_t threads_ = 0;
+        // Linux only, files of at least this size are hashed right from memory
+        // mapping, see block_reader, zero disables
+        uint64_t mmap_threshold_ = 0;
+        // files are hashed without filling page cache, they are read by large
+        // aligned buffers, pages already hashed are dropped from cache and
+        // next file is read ahead, memory mapping isn't used then
+        bool uncached_ = false;
+        // Linux only, with uncached_ files are read with O_DIRECT where
+        // filesystem supports it, there is no read ahead then
+        bool direct_io_ = false;
+#if HAVE_IO_URING
+        // if nonzero, every thread of hashing pool reads files smaller than
+        // 64 KB with io_uring keeping this many of them in flight, see
+        // uring_file_reader, serial engine doesn't use it
+        uintptr_t uring_depth_ = 0;
+#endif
     protected:
     public:
         const auto & modified_only() const {
@@ -139,15 +398,181 @@ class directory_indexer {
             return *this;
         }
 
+        const auto & incremental() const {
+            return incremental_;
+        }
+
+        directory_indexer & incremental(decltype(incremental_) incremental) {
+            incremental_ = incremental;
+            return *this;
+        }
+
+        const auto & hash_order() const {
+            return hash_order_;
+        }
+
+        directory_indexer & hash_order(decltype(hash_order_) hash_order) {
+            hash_order_ = hash_order;
+            return *this;
+        }
+
+        const auto & digest_mode() const {
+            return digest_mode_;
+        }
+
+        directory_indexer & digest_mode(decltype(digest_mode_) digest_mode) {
+            digest_mode_ = digest_mode;
+            return *this;
+        }
+
+        const auto & detect_appends() const {
+            return detect_appends_;
+        }
+
+        directory_indexer & detect_appends(decltype(detect_appends_) detect_appends) {
+            detect_appends_ = detect_appends;
+            return *this;
+        }
+
+        const auto & max_block_size() const {
+            return max_block_size_;
+        }
+
+        directory_indexer & max_block_size(decltype(max_block_size_) max_block_size) {
+            max_block_size_ = max_block_size;
+            return *this;
+        }
+
+        const auto & precheck_size() const {
+            return precheck_size_;
+        }
+
+        directory_indexer & precheck_size(decltype(precheck_size_) precheck_size) {
+            precheck_size_ = precheck_size;
+            return *this;
+        }
+
+        const auto & verify_limit() const {
+            return verify_limit_;
+        }
+
+        directory_indexer & verify_limit(decltype(verify_limit_) verify_limit) {
+            verify_limit_ = verify_limit;
+            return *this;
+        }
+
+        const auto & checkpoint_size() const {
+            return checkpoint_size_;
+        }
+
+        directory_indexer & checkpoint_size(decltype(checkpoint_size_) checkpoint_size) {
+            checkpoint_size_ = checkpoint_size;
+            return *this;
+        }
+
+        const auto & block_digest_size() const {
+            return block_digest_size_;
+        }
+
+        directory_indexer & block_digest_size(decltype(block_digest_size_) block_digest_size) {
+            block_digest_size_ = block_digest_size;
+            return *this;
+        }
+
+        const auto & chunk_avg_size() const {
+            return chunk_avg_size_;
+        }
+
+        directory_indexer & chunk_avg_size(decltype(chunk_avg_size_) chunk_avg_size) {
+            chunk_avg_size_ = chunk_avg_size;
+            return *this;
+        }
+
+        const auto & chunk_min_size() const {
+            return chunk_min_size_;
+        }
+
+        directory_indexer & chunk_min_size(decltype(chunk_min_size_) chunk_min_size) {
+            chunk_min_size_ = chunk_min_size;
+            return *this;
+        }
+
+        const auto & chunk_max_size() const {
+            return chunk_max_size_;
+        }
+
+        directory_indexer & chunk_max_size(decltype(chunk_max_size_) chunk_max_size) {
+            chunk_max_size_ = chunk_max_size;
+            return *this;
+        }
+
+        const auto & threads() const {
+            return threads_;
+        }
+
+        directory_indexer & threads(decltype(threads_) threads) {
+            threads_ = threads;
+            return *this;
+        }
+
+        const auto & mmap_threshold() const {
+            return mmap_threshold_;
+        }
+
+        directory_indexer & mmap_threshold(decltype(mmap_threshold_) mmap_threshold) {
+            mmap_threshold_ = mmap_threshold;
+            return *this;
+        }
+
+        const auto & uncached() const {
+            return uncached_;
+        }
+
+        directory_indexer & uncached(decltype(uncached_) uncached) {
+            uncached_ = uncached;
+            return *this;
+        }
+
+        const auto & direct_io() const {
+            return direct_io_;
+        }
+
+        directory_indexer & direct_io(decltype(direct_io_) direct_io) {
+            direct_io_ = direct_io;
+            return *this;
+        }
+#if HAVE_IO_URING
+        const auto & uring_depth() const {
+            return uring_depth_;
+        }
+
+        directory_indexer & uring_depth(decltype(uring_depth_) uring_depth) {
+            uring_depth_ = uring_depth;
+            return *this;
+        }
+#endif
+
+        // if p_dirty is set only listed directories are reindexed and
+        // directories that appeared in them, entries that disappeared from
+        // them are deleted with subtrees, tree must be indexed before
         void reindex(
             sqlite3pp::database & db,
             const string & dir_path_name,
-            bool * p_shutdown = nullptr);
+            bool * p_shutdown = nullptr,
+            const std::vector<string> * p_dirty = nullptr);
+
+        // journal records with sequence number greater than since in order,
+        // no more than max_count if it is nonzero
+        std::vector<entry_change> changes(
+            sqlite3pp::database & db,
+            uint64_t since,
+            size_t max_count = 0);
 };
 //------------------------------------------------------------------------------
 namespace tests {
 //------------------------------------------------------------------------------
 void indexer_test();
+void reader_bench();
 //------------------------------------------------------------------------------
 } // namespace tests
 //------------------------------------------------------------------------------
@@ -0,0 +1,163 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+#ifndef MATCHER_HPP_INCLUDED
+#define MATCHER_HPP_INCLUDED
+//------------------------------------------------------------------------------
+#pragma once
+//------------------------------------------------------------------------------
+#include <array>
+#include <vector>
+#include <memory>
+#include <unordered_set>
+#include <unordered_map>
+//------------------------------------------------------------------------------
+#include "locale_traits.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+//------------------------------------------------------------------------------
+// Matches file names against list of glob patterns separated by ';'.
+// Glob supports '*', '?' and '[...]' classes ('[!...]' or '[^...]' negates).
+// Exact names and '*literal' suffixes are looked up in hash sets, the rest
+// of patterns is compiled into one NFA and matched by lazily built DFA,
+// so every name is matched in one pass regardless of patterns count.
+// If regex is requested the patterns string is used as ECMAScript regular
+// expression instead. Not thread safe, DFA is built during matching.
+//------------------------------------------------------------------------------
+class name_matcher {
+    private:
+        enum token_type { tok_char, tok_any, tok_class, tok_star, tok_accept };
+
+        struct token {
+            token_type type;
+            string::value_type c;
+            uint32_t cls;
+        };
+
+        struct char_class {
+            bool negate;
+            std::vector<std::pair<string::value_type, string::value_type>> ranges;
+
+            bool match(string::value_type c) const;
+        };
+
+        typedef std::vector<uint64_t> state_set;
+
+        struct state_set_hash {
+            size_t operator () (const state_set & s) const;
+        };
+
+        struct dfa_state {
+            state_set set;
+            bool accept;
+            bool dead;
+            std::array<int32_t, 256> next;
+        };
+
+        // nfa positions of all glob patterns, one tok_accept closes every pattern
+        std::vector<token> nfa_;
+        std::vector<char_class> classes_;
+
+        std::vector<std::unique_ptr<dfa_state>> states_;
+        std::unordered_map<state_set, int32_t, state_set_hash> states_index_;
+        state_set start_;
+        bool flush_ = false;
+
+        std::unordered_set<string> literals_;
+        std::unordered_set<string> suffixes_;
+        std::vector<size_t> suffixes_sizes_;
+        string tail_;
+
+        std::unique_ptr<regex> regex_;
+        bool any_ = false;
+        bool empty_ = true;
+
+        void add_glob(const string & pattern);
+        void closure(state_set & s) const;
+        state_set step(const state_set & s, string::value_type c) const;
+        bool accepting(const state_set & s) const;
+        int32_t state(state_set && s);
+        bool match_dfa(const string & name);
+    protected:
+    public:
+        name_matcher() {}
+        name_matcher(const string & patterns, bool is_regex = false) {
+            compile(patterns, is_regex);
+        }
+
+        void compile(const string & patterns, bool is_regex = false);
+
+        bool empty() const {
+            return empty_;
+        }
+
+        // not const, DFA states and transitions are added to the cache on
+        // first use, so matcher must not be shared between threads, every
+        // directory_reader::read builds its own ones from mask_ and exclude_
+        bool match(const string & name);
+};
+//------------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+//------------------------------------------------------------------------------
+// Rules of one ignore file in gitignore syntax: '#' comments, '!' negation,
+// trailing '/' matches directories only, pattern with '/' is anchored to the
+// ignore file directory, '**' matches any number of directories. Lists are
+// immutable and linked to the list of the nearest parent directory having
+// ignore file, so a chain may be shared between threads reading a subtree.
+//------------------------------------------------------------------------------
+struct ignore_list {
+    struct rule {
+        string pattern;
+        bool negate;
+        bool dir_only;
+        bool name_only;
+    };
+
+    std::shared_ptr<const ignore_list> parent_;
+    // directory of ignore file with trailing delimiter
+    string base_;
+    std::vector<rule> rules_;
+
+    // returns parent if content has no rules
+    static std::shared_ptr<const ignore_list> parse(
+        const std::shared_ptr<const ignore_list> & parent,
+        const string & dir_path,
+        const std::string & utf_content);
+
+    // deeper lists and later rules take precedence
+    bool ignored(const string & path_name, const string & name, bool is_dir) const;
+};
+//------------------------------------------------------------------------------
+namespace tests {
+//------------------------------------------------------------------------------
+void matcher_test();
+//------------------------------------------------------------------------------
+} // namespace tests
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
+#endif // MATCHER_HPP_INCLUDED
+//------------------------------------------------------------------------------
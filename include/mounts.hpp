@@ -0,0 +1,100 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#ifndef MOUNTS_HPP_INCLUDED
+#define MOUNTS_HPP_INCLUDED
+//------------------------------------------------------------------------------
+#pragma once
+//------------------------------------------------------------------------------
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+//------------------------------------------------------------------------------
+#include "locale_traits.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+struct mount_point {
+    string path;
+    string type;
+    string source;
+    uint64_t dev = 0;
+    // directory reader doesn't descend into it
+    bool skip = false;
+};
+//------------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+//------------------------------------------------------------------------------
+// Mounts of the system by mount point path. Pseudo filesystems (procfs,
+// sysfs and so on) and network filesystems are skipped by default, tmpfs
+// and ramfs are not, policy of a type or of a single mount may be changed.
+// Paths are compared literally, directory reader resolves its root path
+// with realpath before lookups.
+//------------------------------------------------------------------------------
+class mount_table {
+    private:
+        std::unordered_map<string, mount_point> mounts_;
+        std::unordered_set<string> skip_types_;
+        std::unordered_map<string, bool> path_policies_;
+
+        void apply(mount_point & mp) const;
+    protected:
+    public:
+        mount_table();
+
+        // parses /proc/self/mountinfo, on other systems table is empty
+        static std::shared_ptr<mount_table> load();
+
+        void parse_mountinfo(const std::string & content);
+
+        bool empty() const {
+            return mounts_.empty();
+        }
+
+        size_t size() const {
+            return mounts_.size();
+        }
+
+        const mount_point * find(const string & path) const {
+            auto i = mounts_.find(path);
+            return i == mounts_.cend() ? nullptr : &i->second;
+        }
+
+        mount_table & skip_type(const string & type, bool skip = true);
+        mount_table & skip_path(const string & path, bool skip = true);
+};
+//------------------------------------------------------------------------------
+namespace tests {
+//------------------------------------------------------------------------------
+void mounts_test();
+//------------------------------------------------------------------------------
+} // namespace tests
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
+#endif // MOUNTS_HPP_INCLUDED
+//------------------------------------------------------------------------------
@@ -0,0 +1,80 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+#ifndef PARALLEL_READER_HPP_INCLUDED
+#define PARALLEL_READER_HPP_INCLUDED
+//------------------------------------------------------------------------------
+#pragma once
+//------------------------------------------------------------------------------
+#include <atomic>
+#include <functional>
+//------------------------------------------------------------------------------
+#include "indexer.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+//------------------------------------------------------------------------------
+// Reads directory tree by several threads. Every thread owns a deque of pending
+// directories, takes work from its back and, when empty, steals from the front
+// of the other threads deques. Entries are delivered to manipulator_ with the
+// same fields as directory_reader does, but concurrently from all threads.
+//------------------------------------------------------------------------------
+struct parallel_directory_reader {
+    std::function<void(directory_reader & dr)> manipulator_;
+
+    // mask, exclude, list_* and level settings are taken from here
+    directory_reader prototype_;
+
+    // zero means std::thread::hardware_concurrency()
+    uintptr_t threads_ = 0;
+
+    std::atomic<bool> abort_;
+
+    parallel_directory_reader() : abort_(false) {
+        prototype_.recursive_ = true;
+    }
+
+    template <typename Manipul>
+    void read(const string & root_path, const Manipul & ml) {
+        this->manipulator_ = [&] (directory_reader & dr) {
+            ml(dr);
+        };
+
+        read(root_path);
+    }
+
+    void read(const string & root_path);
+};
+//------------------------------------------------------------------------------
+namespace tests {
+//------------------------------------------------------------------------------
+void parallel_reader_test();
+//------------------------------------------------------------------------------
+} // namespace tests
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
+#endif // PARALLEL_READER_HPP_INCLUDED
+//------------------------------------------------------------------------------
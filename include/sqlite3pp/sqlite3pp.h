@@ -560,6 +560,15 @@ namespace sqlite3pp {
             return bind(param_name2idx(name), value);
         }
 
+        // int64_t and uint64_t are long on LP64 targets
+        int bind(char const* name, long value) {
+            return bind(param_name2idx(name), (long long int) value);
+        }
+
+        int bind(char const* name, unsigned long value) {
+            return bind(param_name2idx(name), (long long unsigned) value);
+        }
+
         int bind(char const* name, char const* value, copy_semantic fcopy) {
             //auto idx = sqlite3_bind_parameter_index(stmt_, name);
             return bind(param_name2idx(name), value, fcopy);
@@ -855,6 +864,14 @@ namespace sqlite3pp {
                 return sqlite3_column_int64(cmd_->stmt_, idx);
             }
 
+            long get(int idx, long) const {
+                return long(sqlite3_column_int64(cmd_->stmt_, idx));
+            }
+
+            unsigned long get(int idx, unsigned long) const {
+                return (unsigned long) sqlite3_column_int64(cmd_->stmt_, idx);
+            }
+
             long long int & copy_impl(int idx, long long int & v) const {
                 return v = sqlite3_column_int64(cmd_->stmt_, idx);
             }
@@ -901,8 +918,15 @@ namespace sqlite3pp {
             query * cmd_;
         };
 
-        class query_iterator : public std::iterator<std::input_iterator_tag, row>, private row {
+        class query_iterator : private row {
         public:
+            // std::iterator base is deprecated in C++17
+            typedef std::input_iterator_tag iterator_category;
+            typedef row value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef row * pointer;
+            typedef row & reference;
+
             query_iterator() : row(nullptr), rc_(SQLITE_DONE) {}
 
             explicit query_iterator(query * cmd) : row(cmd) {
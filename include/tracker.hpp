@@ -32,6 +32,7 @@
 #include <chrono>
 #include <atomic>
 #include <condition_variable>
+#include <unordered_set>
 //------------------------------------------------------------------------------
 #include "indexer.hpp"
 //------------------------------------------------------------------------------
@@ -52,6 +53,11 @@ class directory_tracker {
         std::mutex mtx_;
         std::condition_variable cv_;
         bool shutdown_;
+        // track changes by inotify/fanotify events instead of periodic rescans
+        bool watch_ = true;
+        // rescan only directories whose stamp has changed, with a full pass
+        // every full_period passes
+        bool incremental_ = false;
 
         void worker();
 
@@ -79,6 +85,24 @@ class directory_tracker {
             return *this;
         }
 
+        const auto & watch() const {
+            return watch_;
+        }
+
+        directory_tracker & watch(decltype(watch_) watch) {
+            watch_ = watch;
+            return *this;
+        }
+
+        const auto & incremental() const {
+            return incremental_;
+        }
+
+        directory_tracker & incremental(decltype(incremental_) incremental) {
+            incremental_ = incremental;
+            return *this;
+        }
+
         void run();
         void shutdown();
 };
@@ -0,0 +1,128 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+#ifndef URING_HPP_INCLUDED
+#define URING_HPP_INCLUDED
+//------------------------------------------------------------------------------
+#pragma once
+//------------------------------------------------------------------------------
+#include "config.h"
+//------------------------------------------------------------------------------
+#if HAVE_IO_URING
+//------------------------------------------------------------------------------
+#include <cstdint>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+//------------------------------------------------------------------------------
+// Minimal io_uring submission/completion queue pair on top of raw syscalls.
+// Not thread safe, every thread must own its queue.
+//------------------------------------------------------------------------------
+class io_uring_queue {
+    private:
+        int fd_ = -1;
+        unsigned entries_ = 0;
+
+        void * sq_ptr_ = nullptr;
+        size_t sq_size_ = 0;
+        void * cq_ptr_ = nullptr;
+        size_t cq_size_ = 0;
+        io_uring_sqe * sqes_ = nullptr;
+        size_t sqes_size_ = 0;
+
+        unsigned * sq_head_ = nullptr;
+        unsigned * sq_tail_ = nullptr;
+        unsigned * sq_mask_ = nullptr;
+        unsigned * sq_array_ = nullptr;
+        unsigned * cq_head_ = nullptr;
+        unsigned * cq_tail_ = nullptr;
+        unsigned * cq_mask_ = nullptr;
+        io_uring_cqe * cqes_ = nullptr;
+
+        // locally queued, not yet submitted to kernel
+        unsigned sq_local_tail_ = 0;
+        unsigned to_submit_ = 0;
+
+        void close();
+
+        io_uring_queue(const io_uring_queue &) = delete;
+        void operator = (const io_uring_queue &) = delete;
+    protected:
+    public:
+        ~io_uring_queue();
+        // throws std::runtime_error if kernel doesn't support io_uring
+        explicit io_uring_queue(unsigned entries);
+
+        const auto & entries() const {
+            return entries_;
+        }
+
+        int fd() const {
+            return fd_;
+        }
+
+        // zeroed submission entry or nullptr if queue is full
+        io_uring_sqe * get_sqe();
+
+        // registers buffers for IORING_OP_READ_FIXED and IORING_OP_WRITE_FIXED,
+        // they are pinned, so RLIMIT_MEMLOCK applies, returns 0 or -errno
+        int register_buffers(const iovec * iov, unsigned n);
+
+        // submit queued entries and wait for at least wait_nr completions,
+        // returns number of submitted entries or -errno
+        int submit(unsigned wait_nr = 0);
+
+        // calls f(user_data, res, flags) for every available completion,
+        // returns number of reaped completions
+        template <typename F>
+        unsigned reap(const F & f) {
+            unsigned head = *cq_head_, n = 0;
+
+            for(;;) {
+                unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+
+                if( head == tail )
+                    break;
+
+                const io_uring_cqe & cqe = cqes_[head & *cq_mask_];
+                f(cqe.user_data, cqe.res, cqe.flags);
+                head++;
+                n++;
+            }
+
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+
+            return n;
+        }
+};
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
+#endif // HAVE_IO_URING
+//------------------------------------------------------------------------------
+#endif // URING_HPP_INCLUDED
+//------------------------------------------------------------------------------
@@ -0,0 +1,106 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#ifndef WATCHER_HPP_INCLUDED
+#define WATCHER_HPP_INCLUDED
+//------------------------------------------------------------------------------
+#pragma once
+//------------------------------------------------------------------------------
+#include "config.h"
+//------------------------------------------------------------------------------
+#if HAVE_INOTIFY
+//------------------------------------------------------------------------------
+#include <unordered_map>
+#include <unordered_set>
+//------------------------------------------------------------------------------
+#include "indexer.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+//------------------------------------------------------------------------------
+// Collects directories under root whose entries changed. Every directory is
+// watched by inotify, when watches limit is exceeded watcher switches to
+// fanotify filesystem mark reporting directory file handles, it needs
+// CAP_SYS_ADMIN and CAP_DAC_READ_SEARCH. If it fails too, constructor or wait
+// throws and watcher no longer covers the whole tree, it must be discarded.
+//------------------------------------------------------------------------------
+class directory_watcher {
+    private:
+        string root_;
+        int fd_ = -1;
+        // fanotify only, descriptor of root to resolve file handles against
+        int mount_fd_ = -1;
+        bool fanotify_ = false;
+        // events were lost, whole tree must be rescanned
+        bool overflow_ = false;
+        std::unordered_map<int, string> watches_;
+
+        void add_watches(const string & path);
+        void remove_watches(const string & path);
+        void switch_to_fanotify();
+        void close();
+
+        void read_inotify(std::unordered_set<string> & dirty);
+        void read_fanotify(std::unordered_set<string> & dirty);
+    protected:
+    public:
+        ~directory_watcher() {
+            close();
+        }
+
+        directory_watcher(const string & root);
+
+        directory_watcher(const directory_watcher &) = delete;
+        void operator = (const directory_watcher &) = delete;
+
+        const auto & fanotify() const {
+            return fanotify_;
+        }
+
+        // returns overflow flag and clears it
+        bool overflow() {
+            auto overflow = overflow_;
+            overflow_ = false;
+            return overflow;
+        }
+
+        // waits up to timeout milliseconds for events and adds changed
+        // directories to dirty, returns false if no events arrived
+        bool wait(int timeout, std::unordered_set<string> & dirty);
+};
+//------------------------------------------------------------------------------
+namespace tests {
+//------------------------------------------------------------------------------
+void watcher_test();
+//------------------------------------------------------------------------------
+} // namespace tests
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
+#endif // HAVE_INOTIFY
+//------------------------------------------------------------------------------
+#endif // WATCHER_HPP_INCLUDED
+//------------------------------------------------------------------------------
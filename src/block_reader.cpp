@@ -0,0 +1,587 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#if _WIN32
+#include <share.h>
+#include <io.h>
+#endif
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#if !_WIN32
+#include <unistd.h>
+#endif
+#if __linux__
+#include <sys/mman.h>
+#include <csignal>
+#endif
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "scope_exit.hpp"
+#include "block_reader.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+bool block_reader::read(
+    const string & path_name,
+    bool (* on_blocks)(void * context, const uint8_t * blocks, size_t count),
+    void * context)
+{
+    int in = -1;
+
+    at_scope_exit(
+        if( in != -1 )
+#if _WIN32
+            _close(in);
+#else
+            ::close(in);
+#endif
+    );
+
+    blocks_ = offset_ / block_size_;
+    bytes_ = blocks_ * block_size_;
+
+#if _WIN32
+    errno_t err = _wsopen_s(&in, path_name.c_str(), _O_RDONLY, _SH_DENYNO, _S_IREAD | _S_IWRITE);
+
+    if( err != 0 )
+        return false;
+#else
+    in = ::open(path_name.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if( in == -1 )
+        return false;
+#endif
+
+    if( bytes_ != 0 &&
+#if _WIN32
+        _lseeki64(in, bytes_, SEEK_SET)
+#else
+        ::lseek(in, off_t(bytes_), SEEK_SET)
+#endif
+        == -1 )
+        return false;
+
+    if( read_size_ != 0 )
+        return read_large(in, on_blocks, context);
+#if __linux__
+    if( mmap_threshold_ != 0 ) {
+        struct stat st;
+
+        if( ::fstat(in, &st) == 0 && S_ISREG(st.st_mode) && uint64_t(st.st_size) >= mmap_threshold_ )
+            return read_mapped(in, st.st_size, on_blocks, context);
+    }
+#endif
+    return read_stream(in, on_blocks, context);
+}
+//------------------------------------------------------------------------------
+bool block_reader::read(
+    const uint8_t * data,
+    size_t size,
+    bool (* on_blocks)(void * context, const uint8_t * blocks, size_t count),
+    void * context)
+{
+    blocks_ = 0;
+    bytes_ = 0;
+    return deliver(data, size, on_blocks, context);
+}
+//------------------------------------------------------------------------------
+bool block_reader::deliver(
+    const uint8_t * data,
+    size_t size,
+    bool (* on_blocks)(void * context, const uint8_t * blocks, size_t count),
+    void * context)
+{
+    size_t count = size / block_size_;
+    size_t tail = size % block_size_;
+
+    if( count != 0 ) {
+        blocks_ += count;
+        bytes_ += count * block_size_;
+
+        if( !on_blocks(context, data, count) )
+            return false;
+    }
+
+    // partial block is padded in own buffer
+    if( tail != 0 ) {
+        buf_.resize(block_size_);
+        std::memcpy(&buf_[0], data + count * block_size_, tail);
+        std::memset(&buf_[tail], 0, block_size_ - tail);
+
+        blocks_++;
+        bytes_ += tail;
+
+        if( !on_blocks(context, &buf_[0], 1) )
+            return false;
+    }
+
+    return true;
+}
+//------------------------------------------------------------------------------
+bool block_reader::read_stream(
+    int fd,
+    bool (* on_blocks)(void * context, const uint8_t * blocks, size_t count),
+    void * context)
+{
+    // several blocks at once, so they may be hashed together, but large
+    // blocks are read one by one
+    constexpr size_t run_size = 1024 * 1024;
+    size_t run_blocks = std::max(size_t(1), std::min(size_t(16), run_size / block_size_));
+    size_t size = block_size_ * run_blocks;
+
+    buf_.resize(size);
+
+    for(;;) {
+        size_t filled = 0;
+
+        while( filled < size ) {
+            auto r =
+#if _WIN32
+                _read(fd, &buf_[filled], uint32_t(size - filled));
+#else
+                ::read(fd, &buf_[filled], size - filled);
+#endif
+
+            if( r == -1 )
+                return false;
+
+            if( r == 0 )
+                break;
+
+            filled += r;
+        }
+
+        if( filled == 0 )
+            break;
+
+        bytes_ += filled;
+
+        // tail of file, there is room for padding as size is multiple of
+        // block size
+        if( filled % block_size_ != 0 ) {
+            std::memset(&buf_[filled], 0, block_size_ - filled % block_size_);
+            filled += block_size_ - filled % block_size_;
+        }
+
+        blocks_ += filled / block_size_;
+
+        if( !on_blocks(context, &buf_[0], filled / block_size_) )
+            return false;
+
+        if( filled < size )
+            break;
+    }
+
+    return true;
+}
+//------------------------------------------------------------------------------
+bool block_reader::read_large(
+    int fd,
+    bool (* on_blocks)(void * context, const uint8_t * blocks, size_t count),
+    void * context)
+{
+    // O_DIRECT requires buffer address, file offset and size of read
+    // aligned on logical block size of device, page size covers it
+    constexpr size_t alignment = 4096;
+    size_t unit = block_size_;
+
+    while( unit % alignment != 0 )
+        unit += block_size_;
+
+    size_t size = read_size_ < unit ? unit : read_size_ - read_size_ % unit;
+
+    large_.resize(size + alignment);
+
+    auto buf = &large_[0] + (alignment - uintptr_t(&large_[0]) % alignment) % alignment;
+    uint64_t offset = bytes_;
+#if __linux__
+    auto flags = ::fcntl(fd, F_GETFL);
+    bool direct = direct_io_ && offset % alignment == 0
+        && flags != -1 && ::fcntl(fd, F_SETFL, flags | O_DIRECT) == 0;
+#endif
+
+    for(;;) {
+        size_t filled = 0;
+
+        while( filled < size ) {
+            auto r =
+#if _WIN32
+                _read(fd, buf + filled, uint32_t(size - filled));
+#else
+                ::read(fd, buf + filled, size - filled);
+#endif
+
+            if( r == -1 ) {
+#if __linux__
+                // some filesystems accept O_DIRECT on open but not on read
+                if( direct && errno == EINVAL && offset == bytes_ && filled == 0 ) {
+                    ::fcntl(fd, F_SETFL, flags);
+                    direct = false;
+                    continue;
+                }
+#endif
+                return false;
+            }
+
+            if( r == 0 )
+                break;
+
+            filled += r;
+#if __linux__
+            // short direct read is the end of file, read at unaligned
+            // position is refused
+            if( direct && filled < size )
+                break;
+#endif
+        }
+
+        // tail of file, there is room for padding as size is multiple of
+        // block size
+        size_t padded = filled;
+        bytes_ += filled;
+
+        if( padded % block_size_ != 0 ) {
+            std::memset(buf + padded, 0, block_size_ - padded % block_size_);
+            padded += block_size_ - padded % block_size_;
+        }
+
+        if( padded != 0 ) {
+            blocks_ += padded / block_size_;
+
+            if( !on_blocks(context, buf, padded / block_size_) )
+                return false;
+        }
+#if __linux__
+        if( drop_cache_ && !direct && filled != 0 )
+            ::posix_fadvise(fd, off_t(offset), off_t(filled), POSIX_FADV_DONTNEED);
+#endif
+        offset += filled;
+
+        if( filled < size )
+            break;
+    }
+
+    return true;
+}
+//------------------------------------------------------------------------------
+void block_reader::prefetch(const string & path_name) const
+{
+#if __linux__
+    if( direct_io_ )
+        return;
+
+    int fd = ::open(path_name.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if( fd == -1 )
+        return;
+
+    ::posix_fadvise(fd, 0, off_t(read_size_), POSIX_FADV_WILLNEED);
+    ::close(fd);
+#else
+    (void) path_name;
+#endif
+}
+//------------------------------------------------------------------------------
+#if __linux__
+//------------------------------------------------------------------------------
+// window of mapping being delivered by read_mapped of this thread, its page
+// beyond the end of file truncated meanwhile raises SIGBUS on access, it is
+// replaced by zero page then and the read fails. Jump out of the handler
+// would skip destructors of frames of on_blocks, so access is repeated.
+static thread_local const uint8_t * volatile mapped_begin = nullptr;
+static thread_local const uint8_t * volatile mapped_end = nullptr;
+static thread_local volatile sig_atomic_t mapped_fault = 0;
+static uintptr_t sigbus_page_size = 0;
+static struct sigaction previous_sigbus;
+//------------------------------------------------------------------------------
+static void on_sigbus(int sig, siginfo_t * info, void * ucontext)
+{
+    auto addr = static_cast<const uint8_t *>(info->si_addr);
+
+    if( addr >= mapped_begin && addr < mapped_end ) {
+        auto page = reinterpret_cast<void *>(uintptr_t(addr) & ~(sigbus_page_size - 1));
+
+        if( ::mmap(page, sigbus_page_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED ) {
+            mapped_fault = 1;
+            return;
+        }
+    }
+
+    // not ours, the previous disposition gets it, default one when access
+    // is repeated
+    if( (previous_sigbus.sa_flags & SA_SIGINFO) != 0 )
+        previous_sigbus.sa_sigaction(sig, info, ucontext);
+    else if( previous_sigbus.sa_handler != SIG_DFL && previous_sigbus.sa_handler != SIG_IGN )
+        previous_sigbus.sa_handler(sig);
+    else
+        ::sigaction(SIGBUS, &previous_sigbus, nullptr);
+}
+//------------------------------------------------------------------------------
+static void install_sigbus_handler()
+{
+    static const bool installed = [] {
+        sigbus_page_size = uintptr_t(::sysconf(_SC_PAGESIZE));
+
+        struct sigaction sa;
+        std::memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = on_sigbus;
+        sa.sa_flags = SA_SIGINFO;
+        sigemptyset(&sa.sa_mask);
+
+        return ::sigaction(SIGBUS, &sa, &previous_sigbus) == 0;
+    }();
+
+    (void) installed;
+}
+//------------------------------------------------------------------------------
+bool block_reader::read_mapped(
+    int fd,
+    uint64_t file_size,
+    bool (* on_blocks)(void * context, const uint8_t * blocks, size_t count),
+    void * context)
+{
+    // window is multiple of both block and page size, so blocks never
+    // straddle windows and window offsets are page aligned
+    const size_t page_size = size_t(::sysconf(_SC_PAGESIZE));
+    size_t unit = block_size_;
+
+    while( unit % page_size != 0 )
+        unit += block_size_;
+
+    size_t window = mmap_window_ < unit ? unit : mmap_window_ - mmap_window_ % unit;
+
+    const uint64_t start = bytes_;
+
+    // mapping must start on page boundary
+    if( start % page_size != 0 )
+        return read_stream(fd, on_blocks, context);
+
+    install_sigbus_handler();
+
+    for( uint64_t offset = start; offset < file_size; offset += window ) {
+        struct stat st;
+
+        // file may have shrunk since the previous window
+        if( ::fstat(fd, &st) != 0 )
+            return false;
+
+        if( uint64_t(st.st_size) < file_size ) {
+            file_size = uint64_t(st.st_size);
+
+            if( offset >= file_size )
+                break;
+        }
+
+        size_t size = size_t(std::min(uint64_t(window), file_size - offset));
+
+        auto p = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, off_t(offset));
+
+        if( p == MAP_FAILED ) {
+            // nothing is delivered yet, read it conventionally
+            if( offset == start )
+                return read_stream(fd, on_blocks, context);
+
+            return false;
+        }
+
+        at_scope_exit( ::munmap(p, size) );
+
+        ::madvise(p, size, MADV_SEQUENTIAL);
+        ::madvise(p, size, MADV_WILLNEED);
+
+        // next window is read ahead while this one is hashed
+        if( offset + size < file_size )
+            ::posix_fadvise(fd, off_t(offset + size), off_t(window), POSIX_FADV_WILLNEED);
+
+        mapped_fault = 0;
+        mapped_begin = static_cast<const uint8_t *>(p);
+        mapped_end = mapped_begin + size;
+
+        at_scope_exit( mapped_begin = mapped_end = nullptr );
+
+        // tail of file is only in the last window
+        bool ok = deliver(static_cast<const uint8_t *>(p), size, on_blocks, context);
+
+        // file was truncated while it was hashed, zeros were hashed
+        if( !ok || mapped_fault != 0 )
+            return false;
+    }
+
+    return true;
+}
+#endif
+//------------------------------------------------------------------------------
+#if HAVE_IO_URING
+//------------------------------------------------------------------------------
+// operation in flight of slot, user data of submission is slot index << 2 | it
+enum {
+    slot_idle = 0,
+    slot_opening = 1,
+    slot_reading = 2,
+    slot_closing = 3
+};
+//------------------------------------------------------------------------------
+uring_file_reader::uring_file_reader(unsigned depth, size_t file_size) :
+    queue_(new io_uring_queue(depth)), file_size_(file_size), slots_(depth)
+{
+    constexpr size_t alignment = 4096;
+
+    file_size_ = (file_size_ + alignment - 1) / alignment * alignment;
+    buffers_.resize(file_size_ * depth + alignment);
+    base_ = &buffers_[0] + (alignment - uintptr_t(&buffers_[0]) % alignment) % alignment;
+
+    std::vector<iovec> iov(depth);
+
+    for( unsigned i = 0; i < depth; i++ ) {
+        iov[i].iov_base = base_ + file_size_ * i;
+        iov[i].iov_len = file_size_;
+    }
+
+    // without registration buffers are mapped by kernel on every read
+    fixed_ = queue_->register_buffers(&iov[0], depth) == 0;
+}
+//------------------------------------------------------------------------------
+void uring_file_reader::run(
+    void (* on_file)(void * context, uint64_t tag, const uint8_t * data, size_t size),
+    void * context)
+{
+    size_t next = 0, busy = 0;
+
+    at_scope_exit(
+        // abnormal exit, completions are lost with descriptors
+        for( auto & s : slots_ ) {
+            if( s.fd != -1 )
+                ::close(s.fd);
+
+            s.fd = -1;
+            s.state = slot_idle;
+        }
+
+        files_.clear();
+    );
+
+    auto sqe_of = [&] (size_t i, int op) {
+        auto sqe = queue_->get_sqe();
+
+        // every slot has at most one operation in flight and queue has at
+        // least as many entries as slots
+        if( sqe == nullptr )
+            throw std::runtime_error("io_uring submission queue overflow");
+
+        sqe->user_data = (uint64_t(i) << 2) | uint64_t(op);
+        slots_[i].state = op;
+
+        return sqe;
+    };
+
+    auto start_close = [&] (size_t i) {
+        auto sqe = sqe_of(i, slot_closing);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = slots_[i].fd;
+    };
+
+    for(;;) {
+        for( size_t i = 0; i < slots_.size() && next < files_.size(); i++ ) {
+            if( slots_[i].state != slot_idle )
+                continue;
+
+            auto sqe = sqe_of(i, slot_opening);
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = uint64_t(uintptr_t(files_[next].first.c_str()));
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            slots_[i].file = next++;
+            busy++;
+        }
+
+        if( busy == 0 )
+            break;
+
+        int r = queue_->submit(1);
+
+        if( r < 0 && r != -EAGAIN && r != -EBUSY )
+            throw std::runtime_error("Failed to submit io_uring, " + std::to_string(-r));
+
+        queue_->reap([&] (uint64_t user_data, int res, uint32_t /*flags*/) {
+            size_t i = size_t(user_data >> 2);
+            auto & s = slots_[i];
+            const auto & file = files_[s.file];
+            auto buf = base_ + file_size_ * i;
+
+            switch( user_data & 3 ) {
+                case slot_opening :
+                    if( res < 0 ) {
+                        s.state = slot_idle;
+                        busy--;
+                        on_file(context, file.second, nullptr, 0);
+                        break;
+                    }
+
+                    s.fd = res;
+
+                    {
+                        auto sqe = sqe_of(i, slot_reading);
+                        sqe->opcode = fixed_ ? IORING_OP_READ_FIXED : IORING_OP_READ;
+                        sqe->fd = s.fd;
+                        sqe->addr = uint64_t(uintptr_t(buf));
+                        sqe->len = unsigned(file_size_);
+                        sqe->off = 0;
+                        sqe->buf_index = uint16_t(i);
+                    }
+
+                    break;
+                case slot_reading :
+                    // full buffer, file may be larger than it
+                    if( res < 0 || size_t(res) >= file_size_ )
+                        on_file(context, file.second, nullptr, 0);
+                    else
+                        on_file(context, file.second, buf, size_t(res));
+
+                    start_close(i);
+                    break;
+                case slot_closing :
+                    // IORING_OP_CLOSE isn't supported by kernel
+                    if( res < 0 )
+                        ::close(s.fd);
+
+                    s.fd = -1;
+                    s.state = slot_idle;
+                    busy--;
+                    break;
+            }
+        });
+    }
+}
+//------------------------------------------------------------------------------
+#endif
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
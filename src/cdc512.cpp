@@ -22,11 +22,18 @@
  * THE SOFTWARE.
  */
 //------------------------------------------------------------------------------
+#include <atomic>
+#include <cstdlib>
 #include <cstring>
 #include <iomanip>
 //------------------------------------------------------------------------------
 #include "cdc512.hpp"
 //------------------------------------------------------------------------------
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CDC512_X86 1
+#include <immintrin.h>
+#endif
+//------------------------------------------------------------------------------
 namespace spacenet {
 //------------------------------------------------------------------------------
 void cdc512_data::shuffle()
@@ -126,6 +133,487 @@ void cdc512::finish()
 	bh = vhtobe64(h);
 }
 //---------------------------------------------------------------------------
+void cdc512::save(uint8_t * state) const
+{
+	const uint64_t v[] = { a, b, c, d, e, f, g, h, p };
+
+	for( size_t i = 0; i < 9; i++ ) {
+		uint64_t x = vhtobe64(v[i]);
+		std::memcpy(state + i * sizeof(x), &x, sizeof(x));
+	}
+}
+//---------------------------------------------------------------------------
+bool cdc512::load(const uint8_t * state, size_t size, uint64_t hashed)
+{
+	if( size != state_size || hashed % sizeof(cdc512_data) != 0 )
+		return false;
+
+	uint64_t * v[] = { &a, &b, &c, &d, &e, &f, &g, &h, &p };
+
+	for( size_t i = 0; i < 9; i++ ) {
+		uint64_t x;
+		std::memcpy(&x, state + i * sizeof(x), sizeof(x));
+		*v[i] = vbe64toh(x);
+	}
+
+	if( p != hashed ) {
+		init();
+		return false;
+	}
+
+	return true;
+}
+//---------------------------------------------------------------------------
+// Multi buffer kernels, every SIMD lane hashes own buffer, rounds are the
+// same as in cdc512_data::shuffle with prefix x of operand names, empty
+// prefix gives shuffle() and v gives shuffle(v)
+//---------------------------------------------------------------------------
+#define CDC512_ROUNDS(x) \
+	a = SUB(a, x##e); f = XOR(f, SHR(x##h,  9)); h = ADD(h, x##a); \
+	b = SUB(b, x##f); g = XOR(g, SHL(x##a,  9)); a = ADD(a, x##b); \
+	c = SUB(c, x##g); h = XOR(h, SHR(x##b, 23)); b = ADD(b, x##c); \
+	d = SUB(d, x##h); a = XOR(a, SHL(x##c, 15)); c = ADD(c, x##d); \
+	e = SUB(e, x##a); b = XOR(b, SHR(x##d, 14)); d = ADD(d, x##e); \
+	f = SUB(f, x##b); c = XOR(c, SHL(x##e, 20)); e = ADD(e, x##f); \
+	g = SUB(g, x##c); d = XOR(d, SHR(x##f, 17)); f = ADD(f, x##g); \
+	h = SUB(h, x##d); e = XOR(e, SHL(x##g, 14)); g = ADD(g, x##h);
+//---------------------------------------------------------------------------
+// loads 64 byte chunk of every lane at offset, pads partial one with zeros
+#define CDC512_LOAD_LANES(lanes, offset, tail) \
+	const uint8_t * chunk[lanes]; \
+	alignas(64) uint8_t pad[lanes][sizeof(cdc512_data)]; \
+	for( size_t l = 0; l < lanes; l++ ) { \
+		chunk[l] = data[l] + (offset); \
+		if( (tail) != 0 ) { \
+			std::memcpy(pad[l], chunk[l], tail); \
+			std::memset(pad[l] + (tail), 0, sizeof(cdc512_data) - (tail)); \
+			chunk[l] = pad[l]; \
+		} \
+	}
+//---------------------------------------------------------------------------
+#define CDC512_STORE_LANES(lanes, vector) \
+	alignas(64) uint64_t out[8][lanes]; \
+	vector(out[0], a); vector(out[1], b); vector(out[2], c); vector(out[3], d); \
+	vector(out[4], e); vector(out[5], f); vector(out[6], g); vector(out[7], h); \
+	for( size_t l = 0; l < lanes; l++ ) \
+		for( size_t i = 0; i < 8; i++ ) { \
+			uint64_t x = vhtobe64(out[i][l]); \
+			std::memcpy(digests + l * sizeof(cdc512_data) + i * sizeof(uint64_t), &x, sizeof(x)); \
+		}
+//---------------------------------------------------------------------------
+static void hash1_generic(const uint8_t * const * data, uintptr_t size, uint8_t * digests)
+{
+	cdc512 ctx(*data, *data + size);
+	std::memcpy(digests, ctx.digest, sizeof(ctx.digest));
+}
+//---------------------------------------------------------------------------
+#if CDC512_X86
+//---------------------------------------------------------------------------
+__attribute__((target("sse2")))
+static void hash2_sse2(const uint8_t * const * data, uintptr_t size, uint8_t * digests)
+{
+#define ADD _mm_add_epi64
+#define SUB _mm_sub_epi64
+#define XOR _mm_xor_si128
+#define SHL _mm_slli_epi64
+#define SHR _mm_srli_epi64
+#define STORE(p, v) _mm_store_si128((__m128i *) (p), v)
+	cdc512 init;
+
+	__m128i a = _mm_set1_epi64x(int64_t(init.a)), b = _mm_set1_epi64x(int64_t(init.b));
+	__m128i c = _mm_set1_epi64x(int64_t(init.c)), d = _mm_set1_epi64x(int64_t(init.d));
+	__m128i e = _mm_set1_epi64x(int64_t(init.e)), f = _mm_set1_epi64x(int64_t(init.f));
+	__m128i g = _mm_set1_epi64x(int64_t(init.g)), h = _mm_set1_epi64x(int64_t(init.h));
+
+	for( uintptr_t offset = 0; offset < size; offset += sizeof(cdc512_data) ) {
+		size_t tail = size - offset < sizeof(cdc512_data) ? size_t(size - offset) : 0;
+
+		CDC512_LOAD_LANES(2, offset, tail)
+
+		// pairs of qwords of both lanes interleaved
+		__m128i v[8];
+
+		for( size_t i = 0; i < 8; i += 2 ) {
+			__m128i r0 = _mm_loadu_si128((const __m128i *) (chunk[0] + i * sizeof(uint64_t)));
+			__m128i r1 = _mm_loadu_si128((const __m128i *) (chunk[1] + i * sizeof(uint64_t)));
+			v[i] = _mm_unpacklo_epi64(r0, r1);
+			v[i + 1] = _mm_unpackhi_epi64(r0, r1);
+		}
+
+		__m128i va = v[0], vb = v[1], vc = v[2], vd = v[3];
+		__m128i ve = v[4], vf = v[5], vg = v[6], vh = v[7];
+
+		CDC512_ROUNDS(v)
+		CDC512_ROUNDS()
+	}
+
+	if( size != 0 ) {
+		__m128i va = _mm_set1_epi64x(int64_t(size));
+		__m128i vb = va, vc = va, vd = va, ve = va, vf = va, vg = va, vh = va;
+
+		CDC512_ROUNDS(v)
+		CDC512_ROUNDS()
+	}
+
+	CDC512_STORE_LANES(2, STORE)
+#undef STORE
+#undef SHR
+#undef SHL
+#undef XOR
+#undef SUB
+#undef ADD
+}
+//---------------------------------------------------------------------------
+__attribute__((target("avx2")))
+static void hash4_avx2(const uint8_t * const * data, uintptr_t size, uint8_t * digests)
+{
+#define ADD _mm256_add_epi64
+#define SUB _mm256_sub_epi64
+#define XOR _mm256_xor_si256
+#define SHL _mm256_slli_epi64
+#define SHR _mm256_srli_epi64
+#define STORE(p, v) _mm256_store_si256((__m256i *) (p), v)
+	cdc512 init;
+
+	__m256i a = _mm256_set1_epi64x(int64_t(init.a)), b = _mm256_set1_epi64x(int64_t(init.b));
+	__m256i c = _mm256_set1_epi64x(int64_t(init.c)), d = _mm256_set1_epi64x(int64_t(init.d));
+	__m256i e = _mm256_set1_epi64x(int64_t(init.e)), f = _mm256_set1_epi64x(int64_t(init.f));
+	__m256i g = _mm256_set1_epi64x(int64_t(init.g)), h = _mm256_set1_epi64x(int64_t(init.h));
+
+	for( uintptr_t offset = 0; offset < size; offset += sizeof(cdc512_data) ) {
+		size_t tail = size - offset < sizeof(cdc512_data) ? size_t(size - offset) : 0;
+
+		CDC512_LOAD_LANES(4, offset, tail)
+
+		// 4x8 qwords of lanes transposed to 8 vectors of one qword of every lane
+		__m256i r0 = _mm256_loadu_si256((const __m256i *) chunk[0]);
+		__m256i r1 = _mm256_loadu_si256((const __m256i *) chunk[1]);
+		__m256i r2 = _mm256_loadu_si256((const __m256i *) chunk[2]);
+		__m256i r3 = _mm256_loadu_si256((const __m256i *) chunk[3]);
+		__m256i t0 = _mm256_unpacklo_epi64(r0, r1), t1 = _mm256_unpackhi_epi64(r0, r1);
+		__m256i t2 = _mm256_unpacklo_epi64(r2, r3), t3 = _mm256_unpackhi_epi64(r2, r3);
+		__m256i va = _mm256_permute2x128_si256(t0, t2, 0x20);
+		__m256i vb = _mm256_permute2x128_si256(t1, t3, 0x20);
+		__m256i vc = _mm256_permute2x128_si256(t0, t2, 0x31);
+		__m256i vd = _mm256_permute2x128_si256(t1, t3, 0x31);
+
+		r0 = _mm256_loadu_si256((const __m256i *) (chunk[0] + 32));
+		r1 = _mm256_loadu_si256((const __m256i *) (chunk[1] + 32));
+		r2 = _mm256_loadu_si256((const __m256i *) (chunk[2] + 32));
+		r3 = _mm256_loadu_si256((const __m256i *) (chunk[3] + 32));
+		t0 = _mm256_unpacklo_epi64(r0, r1), t1 = _mm256_unpackhi_epi64(r0, r1);
+		t2 = _mm256_unpacklo_epi64(r2, r3), t3 = _mm256_unpackhi_epi64(r2, r3);
+		__m256i ve = _mm256_permute2x128_si256(t0, t2, 0x20);
+		__m256i vf = _mm256_permute2x128_si256(t1, t3, 0x20);
+		__m256i vg = _mm256_permute2x128_si256(t0, t2, 0x31);
+		__m256i vh = _mm256_permute2x128_si256(t1, t3, 0x31);
+
+		CDC512_ROUNDS(v)
+		CDC512_ROUNDS()
+	}
+
+	if( size != 0 ) {
+		__m256i va = _mm256_set1_epi64x(int64_t(size));
+		__m256i vb = va, vc = va, vd = va, ve = va, vf = va, vg = va, vh = va;
+
+		CDC512_ROUNDS(v)
+		CDC512_ROUNDS()
+	}
+
+	CDC512_STORE_LANES(4, STORE)
+#undef STORE
+#undef SHR
+#undef SHL
+#undef XOR
+#undef SUB
+#undef ADD
+}
+//---------------------------------------------------------------------------
+// unmasked AVX-512 intrinsics of GCC 12 pass self initialized
+// _mm512_undefined_epi32() as merge source, it is reported as maybe
+// uninitialized once inlined here
+#if __GNUC__ && !__clang__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+__attribute__((target("avx512f")))
+static void hash8_avx512(const uint8_t * const * data, uintptr_t size, uint8_t * digests)
+{
+#define ADD _mm512_add_epi64
+#define SUB _mm512_sub_epi64
+#define XOR _mm512_xor_si512
+#define SHL _mm512_slli_epi64
+#define SHR _mm512_srli_epi64
+#define STORE(p, v) _mm512_store_si512((void *) (p), v)
+	cdc512 init;
+
+	__m512i a = _mm512_set1_epi64(int64_t(init.a)), b = _mm512_set1_epi64(int64_t(init.b));
+	__m512i c = _mm512_set1_epi64(int64_t(init.c)), d = _mm512_set1_epi64(int64_t(init.d));
+	__m512i e = _mm512_set1_epi64(int64_t(init.e)), f = _mm512_set1_epi64(int64_t(init.f));
+	__m512i g = _mm512_set1_epi64(int64_t(init.g)), h = _mm512_set1_epi64(int64_t(init.h));
+
+	for( uintptr_t offset = 0; offset < size; offset += sizeof(cdc512_data) ) {
+		size_t tail = size - offset < sizeof(cdc512_data) ? size_t(size - offset) : 0;
+
+		CDC512_LOAD_LANES(8, offset, tail)
+
+		// 8x8 qwords transposed, pairs of rows are interleaved, then 128 bit
+		// lanes of pairs and of quads are gathered
+		__m512i r[8], t[8], u[8];
+
+		for( size_t l = 0; l < 8; l++ )
+			r[l] = _mm512_loadu_si512((const void *) chunk[l]);
+
+		for( size_t l = 0; l < 8; l += 2 ) {
+			t[l] = _mm512_unpacklo_epi64(r[l], r[l + 1]);
+			t[l + 1] = _mm512_unpackhi_epi64(r[l], r[l + 1]);
+		}
+
+		for( size_t l = 0; l < 8; l += 4 ) {
+			u[l] = _mm512_shuffle_i64x2(t[l], t[l + 2], 0x88);
+			u[l + 1] = _mm512_shuffle_i64x2(t[l], t[l + 2], 0xDD);
+			u[l + 2] = _mm512_shuffle_i64x2(t[l + 1], t[l + 3], 0x88);
+			u[l + 3] = _mm512_shuffle_i64x2(t[l + 1], t[l + 3], 0xDD);
+		}
+
+		__m512i va = _mm512_shuffle_i64x2(u[0], u[4], 0x88);
+		__m512i ve = _mm512_shuffle_i64x2(u[0], u[4], 0xDD);
+		__m512i vc = _mm512_shuffle_i64x2(u[1], u[5], 0x88);
+		__m512i vg = _mm512_shuffle_i64x2(u[1], u[5], 0xDD);
+		__m512i vb = _mm512_shuffle_i64x2(u[2], u[6], 0x88);
+		__m512i vf = _mm512_shuffle_i64x2(u[2], u[6], 0xDD);
+		__m512i vd = _mm512_shuffle_i64x2(u[3], u[7], 0x88);
+		__m512i vh = _mm512_shuffle_i64x2(u[3], u[7], 0xDD);
+
+		CDC512_ROUNDS(v)
+		CDC512_ROUNDS()
+	}
+
+	if( size != 0 ) {
+		__m512i va = _mm512_set1_epi64(int64_t(size));
+		__m512i vb = va, vc = va, vd = va, ve = va, vf = va, vg = va, vh = va;
+
+		CDC512_ROUNDS(v)
+		CDC512_ROUNDS()
+	}
+
+	CDC512_STORE_LANES(8, STORE)
+#undef STORE
+#undef SHR
+#undef SHL
+#undef XOR
+#undef SUB
+#undef ADD
+}
+#if __GNUC__ && !__clang__
+#pragma GCC diagnostic pop
+#endif
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
+// Registry of multi buffer kernels, the widest first, generic one is the
+// last and always supported. Only hash_many is dispatched: single stream
+// update/finish is one serial dependency chain, every round needs results
+// of the previous one, so wider registers or SSE4/BMI2 forms of it gain
+// nothing and init/update/finish stay scalar, CDC512_KERNEL affects only
+// multi buffer hashing.
+//---------------------------------------------------------------------------
+struct cdc512_kernel {
+	const char * name;
+	size_t lanes;
+	bool supported;
+	void (* hash)(const uint8_t * const * data, uintptr_t size, uint8_t * digests);
+};
+//---------------------------------------------------------------------------
+static const cdc512_kernel * kernels_registry()
+{
+	static const cdc512_kernel kernels[] = {
+#if CDC512_X86
+		{ "avx512", 8, __builtin_cpu_supports("avx512f") != 0, hash8_avx512 },
+		{ "avx2", 4, __builtin_cpu_supports("avx2") != 0, hash4_avx2 },
+		{ "sse2", 2, __builtin_cpu_supports("sse2") != 0, hash2_sse2 },
+#endif
+		{ "generic", 1, true, hash1_generic }
+	};
+
+	return kernels;
+}
+//---------------------------------------------------------------------------
+static const cdc512_kernel * find_kernel(const char * name)
+{
+	for( auto k = kernels_registry(); ; k++ ) {
+		if( k->supported && std::strcmp(k->name, name) == 0 )
+			return k;
+
+		if( k->lanes == 1 )
+			return nullptr;
+	}
+}
+//---------------------------------------------------------------------------
+// the widest supported kernel or one pinned by CDC512_KERNEL environment
+// variable
+static std::atomic<const cdc512_kernel *> & selected_kernel()
+{
+	static std::atomic<const cdc512_kernel *> selected([] {
+		auto name = std::getenv("CDC512_KERNEL");
+		auto k = name != nullptr ? find_kernel(name) : nullptr;
+
+		for( k = k != nullptr ? k : kernels_registry(); !k->supported; k++ );
+
+		return k;
+	}());
+
+	return selected;
+}
+//---------------------------------------------------------------------------
+std::vector<const char *> cdc512::kernels()
+{
+	std::vector<const char *> names;
+
+	for( auto k = kernels_registry(); ; k++ ) {
+		if( k->supported )
+			names.push_back(k->name);
+
+		if( k->lanes == 1 )
+			return names;
+	}
+}
+//---------------------------------------------------------------------------
+const char * cdc512::kernel()
+{
+	return selected_kernel().load()->name;
+}
+//---------------------------------------------------------------------------
+bool cdc512::kernel(const char * name)
+{
+	auto k = find_kernel(name);
+
+	if( k == nullptr )
+		return false;
+
+	selected_kernel() = k;
+	return true;
+}
+//---------------------------------------------------------------------------
+void cdc512::hash_many(const uint8_t * const * data, size_t n, uintptr_t size, uint8_t * digests)
+{
+	// remainder is hashed by narrower kernels
+	for( auto k = selected_kernel().load(); n != 0; k++ ) {
+		if( !k->supported )
+			continue;
+
+		for( ; n >= k->lanes; n -= k->lanes, data += k->lanes, digests += k->lanes * sizeof(cdc512_data) )
+			k->hash(data, size, digests);
+	}
+}
+//---------------------------------------------------------------------------
+#undef CDC512_STORE_LANES
+#undef CDC512_LOAD_LANES
+#undef CDC512_ROUNDS
+//---------------------------------------------------------------------------
+void cdc512_tree::join(node & left, const node & right)
+{
+	cdc512 ctx;
+	ctx.update(left.digest, sizeof(left.digest));
+	ctx.update(right.digest, sizeof(right.digest));
+	ctx.finish();
+
+	std::memcpy(left.digest, ctx.digest, sizeof(left.digest));
+	left.leaves += right.leaves;
+}
+//---------------------------------------------------------------------------
+void cdc512_tree::add(const uint8_t * leaf)
+{
+	node n;
+	n.leaves = 1;
+	std::memcpy(n.digest, leaf, sizeof(n.digest));
+	stack_.push_back(n);
+	leaves_++;
+
+	// complete subtrees of equal size are joined
+	while( stack_.size() >= 2 && stack_[stack_.size() - 2].leaves == stack_.back().leaves ) {
+		join(stack_[stack_.size() - 2], stack_.back());
+		stack_.pop_back();
+	}
+}
+//---------------------------------------------------------------------------
+void cdc512_tree::finish(uint8_t * digest)
+{
+	// incomplete right part is joined from right to left
+	while( stack_.size() >= 2 ) {
+		join(stack_[stack_.size() - 2], stack_.back());
+		stack_.pop_back();
+	}
+
+	uint64_t leaves = vhtobe64(leaves_);
+
+	cdc512 ctx;
+
+	if( !stack_.empty() )
+		ctx.update(stack_.back().digest, sizeof(stack_.back().digest));
+
+	ctx.update(&leaves, sizeof(leaves));
+	ctx.finish();
+
+	std::memcpy(digest, ctx.digest, sizeof(ctx.digest));
+	init();
+}
+//---------------------------------------------------------------------------
+void cdc512_tree::save(std::vector<uint8_t> & state) const
+{
+	state.resize(sizeof(uint64_t) + stack_.size() * (sizeof(uint64_t) + sizeof(cdc512_data)));
+
+	auto q = &state[0];
+	uint64_t x = vhtobe64(leaves_);
+	std::memcpy(q, &x, sizeof(x));
+	q += sizeof(x);
+
+	for( const auto & n : stack_ ) {
+		x = vhtobe64(n.leaves);
+		std::memcpy(q, &x, sizeof(x));
+		std::memcpy(q + sizeof(x), n.digest, sizeof(n.digest));
+		q += sizeof(x) + sizeof(n.digest);
+	}
+}
+//---------------------------------------------------------------------------
+bool cdc512_tree::load(const uint8_t * state, size_t size)
+{
+	constexpr size_t node_size = sizeof(uint64_t) + sizeof(cdc512_data);
+
+	init();
+
+	if( size < sizeof(uint64_t) || (size - sizeof(uint64_t)) % node_size != 0 )
+		return false;
+
+	uint64_t x, leaves = 0;
+	std::memcpy(&x, state, sizeof(x));
+	leaves_ = vbe64toh(x);
+
+	for( auto q = state + sizeof(x); q < state + size; q += node_size ) {
+		node n;
+		std::memcpy(&x, q, sizeof(x));
+		n.leaves = vbe64toh(x);
+		std::memcpy(n.digest, q + sizeof(x), sizeof(n.digest));
+
+		// roots are complete subtrees of strictly decreasing size
+		if( n.leaves == 0 || (n.leaves & (n.leaves - 1)) != 0
+			|| (!stack_.empty() && stack_.back().leaves <= n.leaves) ) {
+			init();
+			return false;
+		}
+
+		stack_.push_back(n);
+		leaves += n.leaves;
+	}
+
+	if( leaves != leaves_ ) {
+		init();
+		return false;
+	}
+
+	return true;
+}
+//---------------------------------------------------------------------------
 std::string cdc512::to_string() const
 {
     std::stringstream s;
@@ -0,0 +1,130 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <stdexcept>
+//------------------------------------------------------------------------------
+#include "chunker.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+// random values of bytes, generated by splitmix64 so table is the same for
+// every build and chunk boundaries are stable
+//------------------------------------------------------------------------------
+static const struct gear_table {
+    uint64_t values[256];
+
+    gear_table() {
+        uint64_t x = 0x5350414345474541; // "SPACEGEA"
+
+        for( auto & v : values ) {
+            uint64_t z = (x += 0x9E3779B97F4A7C15);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+            v = z ^ (z >> 31);
+        }
+    }
+} gear;
+//------------------------------------------------------------------------------
+// bits bits spread over high 48 bits of hash, high bits depend on the whole
+// 64 bytes window
+//------------------------------------------------------------------------------
+static uint64_t spread_mask(unsigned bits)
+{
+    uint64_t mask = 0;
+
+    for( unsigned i = 0; i < bits; i++ )
+        mask |= uint64_t(1) << (63 - i * 48 / bits);
+
+    return mask;
+}
+//------------------------------------------------------------------------------
+content_chunker::content_chunker(size_t min_size, size_t avg_size, size_t max_size)
+{
+    if( avg_size < 64 )
+        throw std::runtime_error("content_chunker average size too small");
+
+    unsigned bits = 0;
+
+    while( (size_t(2) << bits) <= avg_size )
+        bits++;
+
+    avg_size_ = size_t(1) << bits;
+    min_size_ = min_size == 0 ? avg_size_ / 4 : min_size;
+    max_size_ = max_size == 0 ? avg_size_ * 8 : max_size;
+
+    if( min_size_ > avg_size_ || max_size_ < avg_size_ )
+        throw std::runtime_error("content_chunker sizes must be min <= avg <= max");
+
+    mask_small_ = spread_mask(bits + 2);
+    mask_large_ = spread_mask(bits - 2);
+}
+//------------------------------------------------------------------------------
+size_t content_chunker::scan(const uint8_t * data, size_t size, bool & cut)
+{
+    cut = false;
+
+    size_t i = 0;
+
+    // cut point skipping, hash starts from zero at min_size
+    if( length_ < min_size_ ) {
+        i = min_size_ - length_ < size ? min_size_ - length_ : size;
+        length_ += i;
+    }
+
+    auto h = hash_;
+
+    auto run = [&] (size_t limit, uint64_t mask) {
+        if( length_ >= limit )
+            return false;
+
+        size_t n = limit - length_ < size - i ? limit - length_ : size - i;
+        size_t end = i + n;
+
+        for( ; i < end; i++ ) {
+            h = (h << 1) + gear.values[data[i]];
+
+            if( (h & mask) == 0 ) {
+                i++;
+                return true;
+            }
+        }
+
+        length_ += n;
+        return false;
+    };
+
+    // cut by hash or at max_size
+    if( run(avg_size_, mask_small_) || run(max_size_, mask_large_) || length_ >= max_size_ ) {
+        cut = true;
+        reset();
+        return i;
+    }
+
+    hash_ = h;
+    return i;
+}
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
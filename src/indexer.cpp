@@ -25,15 +25,24 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#if _WIN32
 #include <share.h>
+#endif
 #include <ctime>
 #include <cerrno>
 #include <cstring>
 #include <iostream>
 #include <fstream>
 #include <atomic>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <map>
 #include <stack>
+#include <vector>
+#include <algorithm>
+#include <random>
 #include <typeinfo>
 #if _WIN32
 #include <process.h>
@@ -41,6 +50,12 @@
 #else
 #include <dirent.h>
 #endif
+#if __linux__
+#include <sys/sysmacros.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
 //------------------------------------------------------------------------------
 #if defined(_S_IFDIR) && !defined(S_IFDIR)
 #define S_IFDIR _S_IFDIR
@@ -60,6 +75,11 @@
 #include "std_ext.hpp"
 #include "locale_traits.hpp"
 #include "cdc512.hpp"
+#include "uring.hpp"
+#include "matcher.hpp"
+#include "bounded_queue.hpp"
+#include "block_reader.hpp"
+#include "chunker.hpp"
 #include "indexer.hpp"
 //------------------------------------------------------------------------------
 namespace spacenet {
@@ -90,12 +110,12 @@ int mkdir(const string & path_name)
             }
             if( err != ERROR_PATH_NOT_FOUND && err != ERROR_ALREADY_EXISTS )
 #else
-        r = mkdir(path_name.c_str(), S_IRUSR | S_IWUSR | S_IXUSR) != 0;
+        r = ::mkdir(path_name.c_str(), S_IRUSR | S_IWUSR | S_IXUSR) != 0;
         if( r ) {
             err = errno;
             if( err == EEXIST )
                 r = false;
-            if( err != ENOTDIR && r != EEXIST )
+            if( err != ENOENT && err != EEXIST )
 #endif
                 throw std::runtime_error("Error create directory, " + std::to_string(err));
         }
@@ -123,7 +143,7 @@ int access(const string & path_name, int mode)
 #if _WIN32
     return _waccess(path_name.c_str(), mode);
 #else
-    return access(path_name.c_str(), mode);
+    return ::access(path_name.c_str(), mode);
 #endif
 }
 //------------------------------------------------------------------------------
@@ -137,7 +157,7 @@ getenv(const string & var_name)
 #if _WIN32
     return _wgetenv(var_name.c_str());
 #else
-    return getenv(var_name.c_str());
+    return ::getenv(var_name.c_str());
 #endif
 }
 //------------------------------------------------------------------------------
@@ -154,9 +174,9 @@ string home_path(bool no_back_slash)
     if( _waccess(s.c_str(), R_OK | W_OK | X_OK) != 0 )
         throw std::runtime_error("Access denied to user home directory");
 #else
-    s = getenv(L"HOME");
+    s = ::getenv("HOME");
 
-    if( access(s.c_str(), R_OK | W_OK | X_OK) != 0 )
+    if( ::access(s.c_str(), R_OK | W_OK | X_OK) != 0 )
         throw std::runtime_error("Access denied to user home directory");
 #endif
     if( no_back_slash ) {
@@ -245,7 +265,12 @@ string temp_name(string dir, string pfx)
     if( pfx.empty() )
         pfx = CPPX_U("temp");
 
-    int pid = _getpid();
+    int pid =
+#if _WIN32
+        _getpid();
+#else
+        ::getpid();
+#endif
     if( access(dir, R_OK | W_OK | X_OK) != 0 )
         throw std::runtime_error("access denied to directory: " + str2utf(dir));
 
@@ -271,7 +296,7 @@ string temp_name(string dir, string pfx)
 	if( try_n >= MAXTRIES )
         throw std::range_error("function temp_name MAXTRIES reached");
 
-    s.resize(strlen(s.c_str()));
+    s.resize(std::strlen(s.c_str()));
 
 	return s;
 }
@@ -304,7 +329,7 @@ string get_cwd(bool no_back_slash)
 		s.resize(s.size() << 1);
     }
 
-    s.resize(strlen(s.c_str()));
+    s.resize(std::strlen(s.c_str()));
 
     if( s.empty() )
 	s = ".";
@@ -312,7 +337,7 @@ string get_cwd(bool no_back_slash)
     if( !no_back_slash )
         s += CPPX_U("/");
 
-	s.shrink_to_fit();
+    s.shrink_to_fit();
 #endif
     if( no_back_slash ) {
         if( s.back() == path_delimiter[0] )
@@ -332,7 +357,7 @@ string path2rel(const string & path, bool no_back_slash)
 #if _WIN32
         file_path = std::str_replace<string>(file_path, CPPX_U("/"), CPPX_U("\\"));
 #else
-        file_path = str_replace(file_path, CPPX_U("\\"), CPPX_U("/"));
+        file_path = std::str_replace<string>(file_path, CPPX_U("\\"), CPPX_U("/"));
 #endif
         //file_path = path.find(path_delimiter[0]) == 0 ? path.substr(1) : path;
 
@@ -355,6 +380,8 @@ struct file_stat :
 	public stat
 #endif
 {
+    file_stat() noexcept {}
+
     file_stat(const string & file_name) noexcept {
 		stat(file_name);
 	}
@@ -368,25 +395,160 @@ struct file_stat :
 	}
 };
 //------------------------------------------------------------------------------
+// later of modification and status change times of directory in nanoseconds,
+// zero if directory can't be stat-ed
+static uint64_t directory_stamp(const string & path)
+{
+    file_stat fs;
+
+    if( fs.stat(path) != 0 )
+        return 0;
+
+#if _WIN32
+    return uint64_t(std::max(fs.st_mtime, fs.st_ctime)) * 1000000000;
+#elif __USE_XOPEN2K8
+    return std::max(
+        uint64_t(fs.st_mtim.tv_sec) * 1000000000 + fs.st_mtim.tv_nsec,
+        uint64_t(fs.st_ctim.tv_sec) * 1000000000 + fs.st_ctim.tv_nsec);
+#else
+    return std::max(
+        uint64_t(fs.st_mtime) * 1000000000 + fs.st_mtimensec,
+        uint64_t(fs.st_ctime) * 1000000000 + fs.st_ctimensec);
+#endif
+}
+//------------------------------------------------------------------------------
 ////////////////////////////////////////////////////////////////////////////////
 //------------------------------------------------------------------------------
+void directory_batch::clear()
+{
+    names.clear();
+    sizes.clear();
+    mtimes.clear();
+    types.clear();
+}
+//------------------------------------------------------------------------------
+void directory_reader::deliver()
+{
+    if( batch_visitor_ == nullptr ) {
+        if( manipulator_ )
+            manipulator_();
+        return;
+    }
+
+    if( batch_.size() == 0 ) {
+        batch_.path = path_;
+        batch_.level = level_;
+    }
+
+    batch_.names.push_back(name_);
+    batch_.sizes.push_back(fsize);
+    batch_.mtimes.push_back(mtime * 1000000000 + mtime_ns);
+    batch_.types.push_back(
+        is_reg ? directory_batch::regular :
+        is_dir ? directory_batch::directory :
+        is_lnk ? directory_batch::symlink : directory_batch::other);
+}
+//------------------------------------------------------------------------------
+std::shared_ptr<const ignore_list> directory_reader::load_ignore(
+    const string & dir_path,
+    const std::shared_ptr<const ignore_list> & parent) const
+{
+    std::ifstream in(dir_path + path_delimiter + ignore_file_, std::ios::binary);
+
+    if( !in )
+        return parent;
+
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    return ignore_list::parse(parent, dir_path, content);
+}
+//------------------------------------------------------------------------------
+void directory_reader::flush_batch()
+{
+    if( batch_visitor_ != nullptr && batch_.size() != 0 ) {
+        batch_visitor_(batch_context_, batch_);
+        batch_.clear();
+    }
+}
+//------------------------------------------------------------------------------
+void directory_reader::prepare(const string & root_path)
+{
+    if( mounts_ == nullptr )
+        mounts_ = mount_table::load();
+
+    boundary_dev_ = root_dev_;
+    remap_root_ = false;
+#if !_WIN32
+    // mount table lists canonical paths, root may be given through symlinks
+    // or with dot components
+    if( !mounts_->empty() ) {
+        root_size_ = root_path.size();
+
+        if( root_size_ != 0 && root_path.back() == path_delimiter[0] )
+            root_size_--;
+
+        char * p = ::realpath(root_path.c_str(), nullptr);
+
+        if( p != nullptr ) {
+            at_scope_exit( ::free(p) );
+
+            canonical_root_ = p;
+
+            if( !canonical_root_.empty() && canonical_root_.back() == path_delimiter[0] )
+                canonical_root_.pop_back();
+
+            remap_root_ = canonical_root_.compare(0, string::npos, root_path, 0, root_size_) != 0;
+        }
+    }
+#endif
+
+    if( one_filesystem_ && boundary_dev_ == 0 ) {
+        file_stat fs;
+
+        if( fs.stat(root_path) == 0 )
+            boundary_dev_ = fs.st_dev;
+    }
+}
+//------------------------------------------------------------------------------
+bool directory_reader::mount_boundary() const
+{
+    if( one_filesystem_ && dev != 0 && boundary_dev_ != 0 && dev != boundary_dev_ )
+        return true;
+
+    // entries not stat-ed have no dev, mount table tells about them
+    auto mp = remap_root_ ? mounts_->find(canonical_root_ + path_name_.substr(root_size_))
+        : mounts_->find(path_name_);
+
+    return mp != nullptr && (mp->skip || (one_filesystem_ && mp->dev != boundary_dev_));
+}
+//------------------------------------------------------------------------------
 void directory_reader::read(const string & root_path)
 {
-    regex mask_regex(mask_.empty() ? CPPX_U(".*") : mask_);
-    regex exclude_regex(exclude_);
+    prepare(root_path);
+
+#if __linux__
+    if( fd_relative_ ) {
+        read_at(root_path);
+        return;
+    }
+#endif
+    // per read, never shared between threads, see name_matcher::match
+    name_matcher mask_matcher(mask_, regex_);
+    name_matcher exclude_matcher(exclude_, regex_);
 
     path_ = root_path;
 
     if( path_.back() == path_delimiter[0] )
         path_.pop_back();
 
-	struct stack_entry {
+    struct stack_entry {
 #if _WIN32
 		HANDLE handle;
 #else
 		DIR * handle;
 #endif
         string path;
+        std::shared_ptr<const ignore_list> ignore;
 	};
 
 	std::stack<stack_entry> stack;
@@ -423,10 +585,14 @@ void directory_reader::read(const string & root_path)
 #endif
 
     abort_ = false;
+    ignore_ = ignore_base_;
+    batch_.clear();
 
 	for(;;) {
         if( abort_ )
             break;
+
+        bool entered = false;
 #if _WIN32
 		DWORD err;
 		WIN32_FIND_DATAW fdw;
@@ -444,8 +610,10 @@ void directory_reader::read(const string & root_path)
             handle = FindFirstFileW((path_ + L"\\*").c_str(), &fdw);
 #else
 		if( handle == nullptr ) {
-			handle = ::opendir(path.c_str());
+			// root directory path is empty after trailing delimiter removal
+			handle = ::opendir(path_.empty() ? path_delimiter : path_.c_str());
 #endif
+            entered = true;
 		}
 		else if( stack.empty() ) {
 			break;
@@ -453,13 +621,14 @@ void directory_reader::read(const string & root_path)
 		else {
 			handle = stack.top().handle;
             path_ = stack.top().path;
+            ignore_ = stack.top().ignore;
 			stack.pop();
 #if _WIN32
             lstrcpyW(fdw.cFileName, L"");
 #endif
 		}
 
-        level_ = stack.size() + 1;
+        level_ = base_level_ + stack.size() + 1;
 #if _WIN32
 		if( handle == INVALID_HANDLE_VALUE ) {
 			err = GetLastError();
@@ -473,10 +642,13 @@ void directory_reader::read(const string & root_path)
 			err = errno;
 			if( err == ENOTDIR )
 				return;
-			throw std::runtime_error("Failed to open directory: " + path + ", " + std::to_string(err));
+			throw std::runtime_error("Failed to open directory: " + path_ + ", " + std::to_string(err));
 #endif
 		}
 
+        if( entered && !ignore_file_.empty() )
+            ignore_ = load_ignore(path_, ignore_);
+
 #if _WIN32
 		at_scope_exit(
 			if( handle != INVALID_HANDLE_VALUE )
@@ -506,18 +678,18 @@ void directory_reader::read(const string & root_path)
 		for(;;) {
 			if( readdir_r(handle, ent, &result) != 0 ) {
 				err = errno;
-				throw std::runtime_error("Failed to read directory: " + path + ", " + std::to_string(err));
+				throw std::runtime_error("Failed to read directory: " + path_ + ", " + std::to_string(err));
 			}
 
 			if( result == nullptr )
 				break;
 
-			if( strcmp(ent->d_name, ".") == 0  && !list_dot )
+			if( strcmp(ent->d_name, ".") == 0  && !list_dot_ )
 				continue;
-			if( strcmp(ent->d_name, "..") == 0 && !list_dotdot )
+			if( strcmp(ent->d_name, "..") == 0 && !list_dotdot_ )
 				continue;
 
-			name = ent->d_name;
+			name_ = ent->d_name;
 #else
 		for(;;) {
 			errno = 0;
@@ -526,21 +698,21 @@ void directory_reader::read(const string & root_path)
 
 			if( ent == nullptr ) {
                 if( err != 0 )
-                    throw std::runtime_error("Failed to read directory: " + path + ", " + std::to_string(err));
+                    throw std::runtime_error("Failed to read directory: " + path_ + ", " + std::to_string(err));
 				break;
 			}
 
-			if( strcmp(ent->d_name, ".") == 0  && !list_dot )
+			if( strcmp(ent->d_name, ".") == 0  && !list_dot_ )
 				continue;
-			if( strcmp(ent->d_name, "..") == 0 && !list_dotdot )
+			if( strcmp(ent->d_name, "..") == 0 && !list_dotdot_ )
 				continue;
 
-			name = ent->d_name;
+			name_ = ent->d_name;
 #endif
-            bool match = std::regex_match(name_, mask_regex);
+            bool match = mask_matcher.empty() || mask_matcher.match(name_);
 
-            if( match && !exclude_.empty() )
-                match = !std::regex_match(name_, exclude_regex);
+            if( match && !exclude_matcher.empty() )
+                match = !exclude_matcher.match(name_);
 
             path_name_ = path_ + path_delimiter + name_;
 
@@ -551,15 +723,19 @@ void directory_reader::read(const string & root_path)
             is_reg = (fdw.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0;
             is_dir = (fdw.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
             is_lnk = false;
+            dev = ino = 0;
+            nlink = 1;
 
             atime = unpack_FILETIME(fdw.ftLastAccessTime, atime_ns);
             ctime = unpack_FILETIME(fdw.ftCreationTime, ctime_ns);
             mtime = unpack_FILETIME(fdw.ftLastWriteTime, mtime_ns);
 #else
-            file_stat fs(path_name);
+            file_stat fs;
 
-			if( (err = errno) != 0 )
-				throw std::runtime_error("Failed to read file info: " + path_name + ", " + std::to_string(err));
+			if( fs.stat(path_name_) != 0 ) {
+                err = errno;
+				throw std::runtime_error("Failed to read file info: " + path_name_ + ", " + std::to_string(err));
+            }
 
 			//if( (fs.st_mode & type_mask) == 0 )
 			//	continue;
@@ -579,7 +755,16 @@ void directory_reader::read(const string & root_path)
             is_reg = S_ISREG(fs.st_mode);
             is_dir = S_ISDIR(fs.st_mode);
             is_lnk = S_ISLNK(fs.st_mode);
+            mode = fs.st_mode;
+            uid = fs.st_uid;
+            gid = fs.st_gid;
+            dev = fs.st_dev;
+            ino = fs.st_ino;
+            nlink = uint32_t(fs.st_nlink);
 #endif
+            // ignored directories are pruned, never opened
+            if( ignore_ != nullptr && ignore_->ignored(path_name_, name_, is_dir) )
+                continue;
 #if _WIN32
 			if( (fdw.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 ) {
 #elif __USE_MISC
@@ -589,9 +774,9 @@ void directory_reader::read(const string & root_path)
 			if( d_type == DT_UNKNOWN ) {
                 struct stat st;
 
-                if( ::stat(path_name.c_str(), &st) != 0 ) {
+                if( ::stat(path_name_.c_str(), &st) != 0 ) {
                     err = errno;
-                    throw std::runtime_error("Failed to stat entry: " + path_name + ", " + std::to_string(err));
+                    throw std::runtime_error("Failed to stat entry: " + path_name_ + ", " + std::to_string(err));
                 }
 
                 d_type = IFTODT(st.st_mode);
@@ -601,19 +786,24 @@ void directory_reader::read(const string & root_path)
 #else
 			struct stat st;
 
-			if( ::stat(path_name.c_str(), &st) != 0 ) {
+			if( ::stat(path_name_.c_str(), &st) != 0 ) {
 				err = errno;
-				throw std::runtime_error("Failed to stat entry: " + path_name + ", " + std::to_string(err));
+				throw std::runtime_error("Failed to stat entry: " + path_name_ + ", " + std::to_string(err));
 			}
 
 			if( (st.st_mode & S_IFDIR) != 0 ) {
 #endif
 
-                if( list_directories_ && match && manipulator_ )
-                    manipulator_();
+                if( list_directories_ && match )
+                    deliver();
+
+                if( recursive_ && (max_level_ == 0 || level_ <= max_level_) && !mount_boundary() ) {
+                    if( spawner_ ) {
+                        spawner_();
+                        continue;
+                    }
 
-                if( recursive_ && (max_level_ == 0 || stack.size() < max_level_ ) ) {
-                    stack.push({ handle, path_ });
+                    stack.push({ handle, path_, ignore_ });
                     path_ += path_delimiter + name_;
 #if _WIN32
 					handle = INVALID_HANDLE_VALUE;
@@ -624,8 +814,7 @@ void directory_reader::read(const string & root_path)
 				}
 			}
 			else if( match ) {
-                if( manipulator_ )
-                    manipulator_();
+                deliver();
 			}
 		}
 #if _WIN32
@@ -637,297 +826,1884 @@ void directory_reader::read(const string & root_path)
                 str2utf(L"Failed to read directory: " + path_ + L", " + std::to_wstring(err)));
 		}
 #endif
+        // here engine leaves directory or descends into subdirectory
+        flush_batch();
 	}
 };
 //------------------------------------------------------------------------------
-////////////////////////////////////////////////////////////////////////////////
+#if __linux__
 //------------------------------------------------------------------------------
-void directory_indexer::reindex(
-    sqlite3pp::database & db,
-    const string & dir_path_name,
-    bool * p_shutdown)
+void directory_reader::read_at(const string & root_path)
 {
-    db.execute_all(R"EOS(
-        CREATE TABLE IF NOT EXISTS entries (
-            is_alive		INTEGER NOT NULL,   /* boolean */
-            /*id			BLOB PRIMARY KEY ON CONFLICT ABORT,*/
-            parent_id		INTEGER NOT NULL,   /* link on entries rowid */
-            name			TEXT NOT NULL,      /* file name*/
-            is_dir			INTEGER,            /* boolean */
-            mtime			INTEGER,            /* INTEGER as Unix Time, the number of seconds since 1970-01-01 00:00:00 UTC. */
-            /*mtime_ns		INTEGER,*/            /* nanoseconds, if supported else zero or NULL */
-            file_size		INTEGER,            /* file size in bytes */
-            block_size		INTEGER,            /* file block size in bytes */
-            digest			BLOB,               /* file checksum */
-            UNIQUE(parent_id, name) ON CONFLICT ABORT
-        ) /*WITHOUT ROWID*/;
-        CREATE UNIQUE INDEX IF NOT EXISTS i1 ON entries (parent_id, name);
-        CREATE INDEX IF NOT EXISTS i2 ON entries (is_alive);
-
-        CREATE TABLE IF NOT EXISTS blocks_digests (
-            entry_id		INTEGER NOT NULL,   /* link on entries rowid */
-            block_no		INTEGER NOT NULL,   /* file block number starting from one */
-            digest			BLOB,               /* file block checksum */
-            UNIQUE(entry_id, block_no) ON CONFLICT ABORT
-        ) /*WITHOUT ROWID*/;
-        CREATE UNIQUE INDEX IF NOT EXISTS i3 ON blocks_digests (entry_id, block_no);
-    )EOS");
+    // per read, parallel reader threads copy mask_ and exclude_ but never
+    // share matchers with their lazily built DFA
+    name_matcher mask_matcher(mask_, regex_);
+    name_matcher exclude_matcher(exclude_, regex_);
 
-    sqlite3pp::query st_sel(db, R"EOS(
-        SELECT
-            rowid,
-            mtime
-        FROM
-            entries
-        WHERE
-            parent_id = :parent_id
-            AND name = :name
-    )EOS");
+    struct stack_entry {
+        DIR * handle;
+        string path;
+        std::vector<string> subdirs;
+        size_t next_subdir;
+        std::shared_ptr<const ignore_list> ignore;
+    };
 
-	sqlite3pp::command st_ins(db, R"EOS(
-        INSERT INTO entries (
-            is_alive, parent_id, name, is_dir, mtime, file_size, block_size, digest
-        ) VALUES (0, :parent_id, :name, :is_dir, NULL, :file_size, :block_size, NULL)
-	)EOS");
-	
-	sqlite3pp::command st_upd(db, R"EOS(
-        UPDATE entries SET
-            is_alive = 0,
-            parent_id = :parent_id,
-            name = :name,
-            is_dir = :is_dir,
-            file_size = :file_size,
-            block_size = :block_size,
-            digest = NULL
-		WHERE
-            parent_id = :parent_id
-            AND name = :name
-	)EOS");
+#if HAVE_STATX
+    typedef struct statx entry_stat;
+#else
+    typedef struct stat entry_stat;
+#endif
 
-    sqlite3pp::command st_upd_touch(db, R"EOS(
-        UPDATE entries SET
-            is_alive = 0
-        WHERE
-            rowid = :id
-    )EOS");
+    struct dir_entry {
+        string name;
+        unsigned char type;
+        ino_t ino;
+        bool match;
+        bool want;
+        bool need_stat;
+        int err;
+        entry_stat st;
+    };
 
-    sqlite3pp::command st_upd_after(db, R"EOS(
-        UPDATE entries SET
-            is_alive = 0,
-            mtime = :mtime,
-            digest = :digest
-        WHERE
-            rowid = :id
-    )EOS");
+    std::vector<stack_entry> stack;
+    std::vector<dir_entry> entries;
+    size_t entries_count = 0;
 
-	sqlite3pp::command st_blk_ins(db, R"EOS(
-        INSERT INTO blocks_digests (
-            entry_id, block_no, digest
-        ) VALUES (
-            :entry_id, :block_no, :digest)
-	)EOS");
+    at_scope_exit(
+        for( auto & e : stack )
+            ::closedir(e.handle);
+    );
 
-	sqlite3pp::command st_blk_upd(db, R"EOS(
-		UPDATE blocks_digests SET
-            digest = :digest
-		WHERE
-            entry_id = :entry_id
-            AND block_no = :block_no
-	)EOS");
+    int err;
 
-    sqlite3pp::command st_blk_del(db, R"EOS(
-        DELETE FROM blocks_digests
-        WHERE
-            entry_id = :entry_id
-            AND block_no > :block_no
-    )EOS");
+    // directory opened relative to descriptor of its parent,
+    // so the kernel resolves only one path component
+    auto open_dir = [&] (int parent_fd, const string & name, const string & path,
+        const std::shared_ptr<const ignore_list> & ignore)
+    {
+        int fd = ::openat(parent_fd, name.c_str(),
+            O_RDONLY | O_DIRECTORY | O_CLOEXEC | (parent_fd == AT_FDCWD ? 0 : O_NOFOLLOW));
 
-    std::unordered_map<std::string, uint64_t> parents;
+        if( fd == -1 ) {
+            err = errno;
+            if( err == ENOTDIR && parent_fd == AT_FDCWD )
+                return false;
+            throw std::runtime_error("Failed to open directory: " + path + ", " + std::to_string(err));
+        }
 
-    typedef std::vector<uint8_t> blob;
+        DIR * handle = ::fdopendir(fd);
 
-    auto update_block_digest = [&] (
-        uint64_t entry_id,
-        uint64_t blk_no,
-        const blob & block_digest)
-    {
-        auto bind = [&] (auto & st) {
-            st.bind("entry_id", entry_id);
-            st.bind("block_no", blk_no);
-            st.bind("digest", block_digest, sqlite3pp::nocopy);
-        };
+        if( handle == nullptr ) {
+            err = errno;
+            ::close(fd);
+            throw std::runtime_error("Failed to open directory: " + path + ", " + std::to_string(err));
+        }
 
-        bind(st_blk_ins);
+        stack.push_back({ handle, path, std::vector<string>(), 0, ignore });
 
-        auto exceptions_safe = db.exceptions();
-        at_scope_exit( db.exceptions(exceptions_safe) );
-        db.exceptions(false);
+        return true;
+    };
 
-        if( st_blk_ins.execute() == SQLITE_CONSTRAINT_UNIQUE ) {
-            db.exceptions(true);
-            bind(st_blk_upd);
-            st_blk_upd.execute();
-        }
+    auto stat_entry = [&] (int fd, dir_entry & e) {
+#if HAVE_STATX
+        e.err = ::statx(fd, e.name.c_str(), AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+            statx_mask_ | STATX_TYPE, &e.st) != 0 ? errno : 0;
+#else
+        e.err = ::fstatat(fd, e.name.c_str(), &e.st, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT) != 0 ? errno : 0;
+#endif
     };
 
-	auto update_entry = [&] (
-        uint64_t parent_id,
-		const std::string & name,
-		bool is_dir,
-        uint64_t mtime,
-        uint64_t file_size,
-        uint64_t block_size,
-        uint64_t * p_mtim = nullptr)
-	{
-		auto bind = [&] (auto & st) {
-            st.bind("parent_id", parent_id);
-            st.bind("name", name, sqlite3pp::nocopy);
+#if HAVE_IO_URING && HAVE_STATX
+    if( uring_depth_ != 0 && uring_ == nullptr ) {
+        try {
+            uring_ = std::make_shared<io_uring_queue>(unsigned(uring_depth_));
+        }
+        catch( const std::runtime_error & ) {
+            // no io_uring in kernel or it is prohibited, stay synchronous
+            uring_depth_ = 0;
+        }
+    }
 
-			if( is_dir )
-                st.bind("is_dir", is_dir);
-			else
-                st.bind("is_dir", nullptr);
+    // whole directory is submitted by batches of uring_depth_ entries,
+    // results are delivered in readdir order after all completions are reaped
+    auto stat_entries_uring = [&] (int fd) {
+        auto & q = *uring_;
+        size_t next = 0;
+        uintptr_t inflight = 0, depth = std::min(uintptr_t(q.entries()), uring_depth_);
 
-            if( file_size == 0 )
-                st.bind("file_size", nullptr);
-            else
-                st.bind("file_size", file_size);
+        for(;;) {
+            while( next < entries_count && inflight < depth ) {
+                auto & e = entries[next];
 
-            if( block_size == 0 )
-                st.bind("block_size", nullptr);
-            else
-                st.bind("block_size", block_size);
-        };
-		
-        auto exceptions_safe = db.exceptions();
-        at_scope_exit( db.exceptions(exceptions_safe) );
+                if( !e.need_stat ) {
+                    next++;
+                    continue;
+                }
 
-        st_sel.bind("parent_id", parent_id);
-        st_sel.bind("name", name, sqlite3pp::nocopy);
+                io_uring_sqe * sqe = q.get_sqe();
 
-        uint64_t id = 0, mtim = 0;
+                if( sqe == nullptr )
+                    break;
 
-        auto get_id_mtim = [&] {
-            auto i = st_sel.begin();
+                sqe->opcode = IORING_OP_STATX;
+                sqe->fd = fd;
+                sqe->addr = uintptr_t(e.name.c_str());
+                sqe->len = statx_mask_ | STATX_TYPE;
+                sqe->off = uintptr_t(&e.st);
+                sqe->statx_flags = AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT;
+                sqe->user_data = next;
 
-            if( i ) {
-                id = i->get<uint64_t>("rowid");
-                mtim = i->get<uint64_t>("mtime");
+                next++;
+                inflight++;
             }
-        };
 
-        db.exceptions(true);
-        get_id_mtim();
+            if( inflight == 0 )
+                break;
 
-        // then mtime not changed, just touch entry
-        if( modified_only_ && id != 0 && (mtim == mtime || mtime == 0) ) {
-            st_upd_touch.bind("id", id);
-            st_upd_touch.execute();
-        }
-        else {
-            db.exceptions(false);
-            bind(st_ins);
+            int r = q.submit(1);
 
-            if( st_ins.execute() == SQLITE_CONSTRAINT_UNIQUE ) {
-                db.exceptions(true);
-                bind(st_upd);
-                st_upd.execute();
-            }
-        }
+            if( r < 0 )
+                throw std::runtime_error("Failed to submit io_uring statx: " + path_ + ", " + std::to_string(-r));
 
-        if( p_mtim != nullptr )
-            *p_mtim = mtim;
+            inflight -= q.reap([&] (uint64_t user_data, int res, unsigned) {
+                entries[user_data].err = res < 0 ? -res : 0;
+            });
+        }
 
-        if( id == 0 )
-            get_id_mtim();
+        // kernel older than 5.6 has no IORING_OP_STATX
+        for( size_t i = 0; i < entries_count; i++ ) {
+            auto & e = entries[i];
 
-        return id;
+            if( e.need_stat && e.err == EINVAL ) {
+                uring_depth_ = 0;
+                stat_entry(fd, e);
+            }
+        }
     };
+#endif
 
-    auto update_blocks = [&] (
-        cdc512 & file_ctx,
-        const string & path_name,
-        uint64_t entry_id,
-        size_t block_size)
-    {
-        int in = -1;
+    auto load_ignore = [&] (int fd, stack_entry & se) {
+        int in = ::openat(fd, ignore_file_.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
 
-        at_scope_exit(
-            if( in != -1 )
-                _close(in);
-        );
+        if( in == -1 )
+            return;
 
-        errno_t err =
-#if _WIN32
-        _wsopen_s
-#else
-        _sopen_s
-#endif
-        (&in, path_name.c_str(), _O_RDONLY, _SH_DENYNO, _S_IREAD | _S_IWRITE);
-        //std::wifstream in(dr.path_name, std::ios::binary);
-        //in.exceptions(std::ios::failbit | std::ios::badbit);
-        if( err != 0 )
-            //throw std::runtime_error(
-            //    "Failed open file: " + utf_path_name + ", " + std::to_string(err));
-            return false;
+        at_scope_exit( ::close(in) );
 
-        uint64_t blk_no = 0;
-        std::vector<uint8_t> buf(block_size);
+        std::string content;
+        char buf[4096];
 
-        for(;;) {//while( !in.eof() ) {
-            blk_no++;
-            //in.read(reinterpret_cast<char *>(buf), BLOCK_SIZE);
-            //auto r = in.gcount();
+        for(;;) {
+            auto r = ::read(in, buf, sizeof(buf));
 
-            auto r = _read(in, &buf[0], uint32_t(block_size));
+            if( r < 0 && errno == EINTR )
+                continue;
 
-            if( r == -1 ) {
-                //err = errno;
-                //throw std::runtime_error(
-                //    "Failed read file: " + utf_path_name + ", " + std::to_string(err));
+            if( r <= 0 )
+                break;
+
+            content.append(buf, r);
+        }
+
+        se.ignore = ignore_list::parse(se.ignore, se.path, content);
+    };
+
+    auto read_entries = [&] (stack_entry & se) {
+        entries_count = 0;
+
+        for(;;) {
+            errno = 0;
+            struct dirent * ent = ::readdir(se.handle);
+
+            if( ent == nullptr ) {
+                if( (err = errno) != 0 )
+                    throw std::runtime_error("Failed to read directory: " + se.path + ", " + std::to_string(err));
+                break;
+            }
+
+            if( strcmp(ent->d_name, ".") == 0  && !list_dot_ )
+                continue;
+            if( strcmp(ent->d_name, "..") == 0 && !list_dotdot_ )
+                continue;
+
+            if( entries_count == entries.size() )
+                entries.emplace_back();
+
+            auto & e = entries[entries_count++];
+            e.name = ent->d_name;
+            e.type = ent->d_type;
+            e.ino = ent->d_ino;
+        }
+
+        // inode tables are read sequentially instead of in hash order of names
+        if( inode_order_ )
+            std::sort(entries.begin(), entries.begin() + entries_count,
+                [] (const dir_entry & a, const dir_entry & b) { return a.ino < b.ino; });
+    };
+
+    auto process_entries = [&] {
+        auto & se = stack.back();
+        int fd = ::dirfd(se.handle);
+
+        path_ = se.path;
+        level_ = base_level_ + stack.size();
+        batch_.clear();
+
+        bool descend = recursive_ && (max_level_ == 0 || level_ <= max_level_);
+#if HAVE_STATX
+        bool stat_all = statx_mask_ != 0;
+#else
+        constexpr bool stat_all = true;
+#endif
+
+        read_entries(se);
+
+        if( !ignore_file_.empty() )
+            for( size_t i = 0; i < entries_count; i++ )
+                if( entries[i].name == ignore_file_ ) {
+                    load_ignore(fd, se);
+                    break;
+                }
+
+        ignore_ = se.ignore;
+
+        bool stat_any = false;
+
+        for( size_t i = 0; i < entries_count; i++ ) {
+            auto & e = entries[i];
+
+            e.match = mask_matcher.empty() || mask_matcher.match(e.name);
+
+            if( e.match && !exclude_matcher.empty() )
+                e.match = !exclude_matcher.match(e.name);
+
+            // trust d_type, don't even stat entries which will be neither
+            // delivered nor descended into
+            bool maybe_dir = e.type == DT_DIR || e.type == DT_UNKNOWN;
+            bool deliver = e.match && (list_directories_ || e.type != DT_DIR);
+
+            e.want = deliver || (maybe_dir && descend);
+
+            // ignored directories are pruned, never opened
+            if( e.want && se.ignore != nullptr && e.type != DT_UNKNOWN
+                && se.ignore->ignored(path_ + path_delimiter + e.name, e.name, e.type == DT_DIR) )
+                e.want = false;
+
+            e.need_stat = e.want && (e.type == DT_UNKNOWN || (stat_all && deliver));
+            e.err = 0;
+            stat_any = stat_any || e.need_stat;
+        }
+
+        if( stat_any ) {
+#if HAVE_IO_URING && HAVE_STATX
+            if( uring_depth_ != 0 )
+                stat_entries_uring(fd);
+            else
+#endif
+            for( size_t i = 0; i < entries_count; i++ )
+                if( entries[i].need_stat )
+                    stat_entry(fd, entries[i]);
+        }
+
+        at_fd_ = fd;
+
+        at_scope_exit( at_fd_ = -1 );
+
+        for( size_t i = 0; i < entries_count; i++ ) {
+            if( abort_ )
+                break;
+
+            const auto & e = entries[i];
+
+            if( !e.want )
+                continue;
+
+            name_ = e.name;
+            path_name_ = path_ + path_delimiter + name_;
+
+            if( e.need_stat ) {
+                // entry vanished after readdir
+                if( e.err == ENOENT )
+                    continue;
+
+                if( e.err != 0 )
+                    throw std::runtime_error("Failed to read file info: " + path_name_ + ", " + std::to_string(e.err));
+#if HAVE_STATX
+                atime = e.st.stx_atime.tv_sec;
+                ctime = e.st.stx_ctime.tv_sec;
+                mtime = e.st.stx_mtime.tv_sec;
+                atime_ns = e.st.stx_atime.tv_nsec;
+                ctime_ns = e.st.stx_ctime.tv_nsec;
+                mtime_ns = e.st.stx_mtime.tv_nsec;
+                fsize = e.st.stx_size;
+                mode = e.st.stx_mode;
+                uid = e.st.stx_uid;
+                gid = e.st.stx_gid;
+                dev = makedev(e.st.stx_dev_major, e.st.stx_dev_minor);
+                ino = e.st.stx_ino;
+                nlink = e.st.stx_nlink;
+#else
+                atime = e.st.st_atim.tv_sec;
+                ctime = e.st.st_ctim.tv_sec;
+                mtime = e.st.st_mtim.tv_sec;
+                atime_ns = e.st.st_atim.tv_nsec;
+                ctime_ns = e.st.st_ctim.tv_nsec;
+                mtime_ns = e.st.st_mtim.tv_nsec;
+                fsize = e.st.st_size;
+                mode = e.st.st_mode;
+                uid = e.st.st_uid;
+                gid = e.st.st_gid;
+                dev = e.st.st_dev;
+                ino = e.st.st_ino;
+                nlink = uint32_t(e.st.st_nlink);
+#endif
+            }
+            else {
+                atime = ctime = mtime = 0;
+                atime_ns = ctime_ns = mtime_ns = 0;
+                fsize = 0;
+                mode = DTTOIF(e.type);
+                uid = gid = 0;
+                dev = ino = 0;
+                nlink = 0;
+            }
+
+            is_reg = S_ISREG(mode);
+            is_dir = S_ISDIR(mode);
+            is_lnk = S_ISLNK(mode);
+
+            if( e.type == DT_UNKNOWN && se.ignore != nullptr && se.ignore->ignored(path_name_, name_, is_dir) )
+                continue;
+
+            if( is_dir ) {
+                if( list_directories_ && e.match )
+                    deliver();
+
+                if( descend && !mount_boundary() ) {
+                    if( spawner_ )
+                        spawner_();
+                    else
+                        se.subdirs.push_back(name_);
+                }
+            }
+            else if( e.match ) {
+                deliver();
+            }
+        }
+
+        flush_batch();
+    };
+
+    path_ = root_path;
+
+    if( path_.back() == path_delimiter[0] )
+        path_.pop_back();
+
+    abort_ = false;
+
+    // root directory path is empty after trailing delimiter removal
+    if( !open_dir(AT_FDCWD, path_.empty() ? string(path_delimiter) : path_, path_, ignore_base_) )
+        return;
+
+    process_entries();
+
+    while( !stack.empty() && !abort_ ) {
+        auto & se = stack.back();
+
+        if( se.next_subdir < se.subdirs.size() ) {
+            const auto & name = se.subdirs[se.next_subdir++];
+
+            // se is invalidated by push_back in open_dir
+            if( open_dir(::dirfd(se.handle), name, se.path + path_delimiter + name, se.ignore) )
+                process_entries();
+        }
+        else {
+            ::closedir(se.handle);
+            stack.pop_back();
+        }
+    }
+}
+//------------------------------------------------------------------------------
+#endif
+//------------------------------------------------------------------------------
+bool directory_reader::accessible(int amode) const
+{
+#if _WIN32
+    return access(path_name_, amode) == 0;
+#else
+    static const uid_t euid = ::geteuid();
+    static const std::vector<gid_t> groups = [] {
+        std::vector<gid_t> v;
+        int n = ::getgroups(0, nullptr);
+
+        if( n > 0 ) {
+            v.resize(n);
+            n = ::getgroups(n, v.data());
+            // on failure only primary group is checked
+            v.resize(n > 0 ? n : 0);
+        }
+
+        v.push_back(::getegid());
+
+        return v;
+    }();
+
+    amode &= R_OK | W_OK | X_OK;
+
+    if( euid == 0 ) {
+        if( (amode & X_OK) == 0 || is_dir || (mode & (S_IXUSR | S_IXGRP | S_IXOTH)) != 0 )
+            return true;
+    }
+    else {
+        uint32_t bits = mode;
+
+        if( uid == euid )
+            bits >>= 6;
+        else if( std::find(groups.cbegin(), groups.cend(), gid_t(gid)) != groups.cend() )
+            bits >>= 3;
+
+        if( (bits & amode) == uint32_t(amode) )
+            return true;
+    }
+
+    // mode bits know nothing of ACLs and capabilities, the kernel decides
+    // for entries they deny access to
+    if( at_fd_ != -1 )
+        return ::faccessat(at_fd_, name_.c_str(), amode, AT_EACCESS) == 0;
+
+    return ::faccessat(AT_FDCWD, path_name_.c_str(), amode, AT_EACCESS) == 0;
+#endif
+}
+//------------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+#if __linux__
+//------------------------------------------------------------------------------
+// physical offset of the first extent of file, zero if it is unknown
+static uint64_t first_extent_offset(const string & path_name)
+{
+    int fd = ::open(path_name.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+
+    if( fd == -1 )
+        return 0;
+
+    at_scope_exit( ::close(fd) );
+
+    alignas(fiemap) char buf[sizeof(fiemap) + sizeof(fiemap_extent)];
+    std::memset(buf, 0, sizeof(buf));
+
+    auto fm = reinterpret_cast<fiemap *>(buf);
+    fm->fm_start = 0;
+    fm->fm_length = FIEMAP_MAX_OFFSET;
+    fm->fm_extent_count = 1;
+
+    if( ::ioctl(fd, FS_IOC_FIEMAP, fm) != 0 || fm->fm_mapped_extents == 0 )
+        return 0;
+
+    return fm->fm_extents[0].fe_physical;
+}
+#endif
+//------------------------------------------------------------------------------
+static void add_column(
+    sqlite3pp::database & db,
+    const std::string & table,
+    const std::string & column,
+    const std::string & declaration)
+{
+    sqlite3pp::query st(db, ("PRAGMA table_info(" + table + ")").c_str());
+
+    for( auto i = st.begin(); i != st.end(); ++i )
+        if( i->get<std::string>(1) == column )
+            return;
+
+    st.reset();
+    db.execute(("ALTER TABLE " + table + " ADD COLUMN " + column + " " + declaration).c_str());
+}
+//------------------------------------------------------------------------------
+static bool table_exists(sqlite3pp::database & db, const char * table)
+{
+    sqlite3pp::query st(db, R"EOS(
+        SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = :name
+    )EOS");
+
+    st.bind("name", table, sqlite3pp::nocopy);
+
+    return st.begin() != st.end();
+}
+//------------------------------------------------------------------------------
+static void create_schema(sqlite3pp::database & db)
+{
+    db.execute_all(R"EOS(
+        CREATE TABLE IF NOT EXISTS entries (
+            is_alive		INTEGER NOT NULL,   /* boolean */
+            /*id			BLOB PRIMARY KEY ON CONFLICT ABORT,*/
+            parent_id		INTEGER NOT NULL,   /* link on entries rowid */
+            name			TEXT NOT NULL,      /* file name*/
+            is_dir			INTEGER,            /* boolean */
+            mtime			INTEGER,            /* INTEGER as Unix Time, the number of seconds since 1970-01-01 00:00:00 UTC. */
+            /*mtime_ns		INTEGER,*/            /* nanoseconds, if supported else zero or NULL */
+            file_size		INTEGER,            /* file size in bytes */
+            block_size		INTEGER,            /* file block size in bytes */
+            digest			BLOB,               /* file checksum */
+            dev				INTEGER,            /* st_dev of file when digest was calculated */
+            ino				INTEGER,            /* st_ino of file when digest was calculated */
+            digest_mode		INTEGER,            /* directory_indexer::digest_mode_type of digest, NULL as sequential */
+            chunking		TEXT,               /* min/avg/max sizes of content defined chunks, NULL for fixed blocks */
+            digest_state	BLOB,               /* state of digest after the last full block, for appends */
+            deferred		INTEGER,            /* boolean, mtime changed but sampled content didn't, digest is to be verified */
+            checkpoint_mtime INTEGER,           /* mtime of file whose hashing was interrupted */
+            checkpoint_block INTEGER,           /* number of its blocks hashed into checkpoint_state, hashing resumes after them */
+            checkpoint_state BLOB,              /* state of digest after them */
+            block_digest_size INTEGER,          /* bytes of leading part of block digests stored, NULL as whole digest */
+            UNIQUE(parent_id, name) ON CONFLICT ABORT
+        ) /*WITHOUT ROWID*/;
+        CREATE UNIQUE INDEX IF NOT EXISTS i1 ON entries (parent_id, name);
+        CREATE INDEX IF NOT EXISTS i2 ON entries (is_alive);
+
+        CREATE TABLE IF NOT EXISTS blocks_digests (
+            entry_id		INTEGER NOT NULL,   /* link on entries rowid */
+            block_no		INTEGER NOT NULL,   /* file block number starting from one */
+            digest			BLOB,               /* file block checksum */
+            offset			INTEGER,            /* offset of content defined chunk, NULL for fixed block */
+            length			INTEGER,            /* length of content defined chunk, NULL for fixed block */
+            UNIQUE(entry_id, block_no) ON CONFLICT ABORT
+        ) /*WITHOUT ROWID*/;
+        CREATE UNIQUE INDEX IF NOT EXISTS i3 ON blocks_digests (entry_id, block_no);
+
+        CREATE TABLE IF NOT EXISTS changes (
+            seq				INTEGER PRIMARY KEY AUTOINCREMENT, /* never reused */
+            entry_id		INTEGER NOT NULL,   /* link on entries rowid */
+            parent_id		INTEGER NOT NULL,   /* link on entries rowid */
+            name			TEXT NOT NULL,      /* file name */
+            kind			INTEGER NOT NULL    /* entry_change::kind_type */
+        );
+    )EOS");
+
+    // columns added to existing databases
+    add_column(db, "entries", "dev", "INTEGER");
+    add_column(db, "entries", "ino", "INTEGER");
+    add_column(db, "entries", "digest_mode", "INTEGER");
+    add_column(db, "entries", "chunking", "TEXT");
+    add_column(db, "entries", "digest_state", "BLOB");
+    add_column(db, "entries", "deferred", "INTEGER");
+    add_column(db, "entries", "checkpoint_mtime", "INTEGER");
+    add_column(db, "entries", "checkpoint_block", "INTEGER");
+    add_column(db, "entries", "checkpoint_state", "BLOB");
+    add_column(db, "entries", "block_digest_size", "INTEGER");
+    add_column(db, "blocks_digests", "offset", "INTEGER");
+    add_column(db, "blocks_digests", "length", "INTEGER");
+}
+//------------------------------------------------------------------------------
+std::vector<entry_change> directory_indexer::changes(
+    sqlite3pp::database & db,
+    uint64_t since,
+    size_t max_count)
+{
+    std::vector<entry_change> list;
+
+    // reader doesn't change schema, database isn't indexed yet
+    if( !table_exists(db, "changes") )
+        return list;
+
+    sqlite3pp::query st(db, R"EOS(
+        SELECT
+            seq,
+            entry_id,
+            parent_id,
+            name,
+            kind
+        FROM
+            changes
+        WHERE
+            seq > :since
+        ORDER BY
+            seq
+        LIMIT :max_count
+    )EOS");
+
+    st.bind("since", since);
+
+    if( max_count == 0 )
+        st.bind("max_count", -1);
+    else
+        st.bind("max_count", uint64_t(max_count));
+
+    for( auto i = st.begin(); i != st.end(); ++i ) {
+        entry_change c;
+        c.seq = i->get<uint64_t>(0);
+        c.entry_id = i->get<uint64_t>(1);
+        c.parent_id = i->get<uint64_t>(2);
+        c.name = i->get<std::string>(3);
+        c.kind = entry_change::kind_type(i->get<int>(4));
+        list.emplace_back(std::move(c));
+    }
+
+    return list;
+}
+//------------------------------------------------------------------------------
+void directory_indexer::reindex(
+    sqlite3pp::database & db,
+    const string & dir_path_name,
+    bool * p_shutdown,
+    const std::vector<string> * p_dirty)
+{
+    if( block_digest_size_ == 0 || block_digest_size_ > sizeof(cdc512_data) )
+        throw std::runtime_error("Invalid block digest size");
+
+    create_schema(db);
+
+    // chunker parameters stored with digests, empty for fixed blocks
+    std::string chunking;
+
+    if( chunk_avg_size_ != 0 ) {
+        content_chunker chunker(chunk_min_size_, chunk_avg_size_, chunk_max_size_);
+        chunking = std::to_string(chunker.min_size())
+            + "/" + std::to_string(chunker.avg_size())
+            + "/" + std::to_string(chunker.max_size());
+    }
+
+    // digest of other mode or blocks of other chunking or size are stale as
+    // if file were modified
+    sqlite3pp::query st_sel(db, R"EOS(
+        SELECT
+            rowid,
+            CASE
+                WHEN digest IS NULL OR (
+                    IFNULL(digest_mode, 0) = :digest_mode
+                    AND IFNULL(chunking, '') = :chunking
+                    AND IFNULL(block_size, 0) = :block_size
+                    AND IFNULL(block_digest_size, 64) = :block_digest_size
+                ) THEN mtime
+            END AS mtime,
+            CASE
+                WHEN digest IS NOT NULL AND IFNULL(digest_mode, 0) = :digest_mode AND chunking IS NULL
+                    AND IFNULL(block_size, 0) = :block_size
+                    AND IFNULL(block_digest_size, 64) = :block_digest_size
+                THEN file_size
+            END AS digested_size,
+            ino,
+            digest_state IS NOT NULL AS resumable,
+            CASE
+                WHEN digest IS NULL AND IFNULL(digest_mode, 0) = :digest_mode AND :chunking = ''
+                    AND IFNULL(block_digest_size, 64) = :block_digest_size
+                THEN checkpoint_mtime
+            END AS checkpoint_mtime,
+            checkpoint_block
+        FROM
+            entries
+        WHERE
+            parent_id = :parent_id
+            AND name = :name
+    )EOS");
+
+	sqlite3pp::command st_ins(db, R"EOS(
+        INSERT INTO entries (
+            is_alive, parent_id, name, is_dir, mtime, file_size, block_size, digest
+        ) VALUES (0, :parent_id, :name, :is_dir, NULL, :file_size, :block_size, NULL)
+	)EOS");
+	
+	sqlite3pp::command st_upd(db, R"EOS(
+        UPDATE entries SET
+            is_alive = 0,
+            parent_id = :parent_id,
+            name = :name,
+            is_dir = :is_dir,
+            file_size = :file_size,
+            block_size = :block_size,
+            digest = NULL
+		WHERE
+            parent_id = :parent_id
+            AND name = :name
+	)EOS");
+
+    // content of file is sampled as unchanged though mtime is changed
+    sqlite3pp::command st_upd_defer(db, R"EOS(
+        UPDATE entries SET
+            is_alive = 0,
+            mtime = :mtime,
+            deferred = 1
+        WHERE
+            rowid = :id
+    )EOS");
+
+    sqlite3pp::command st_upd_touch(db, R"EOS(
+        UPDATE entries SET
+            is_alive = 0
+        WHERE
+            rowid = :id
+    )EOS");
+
+    sqlite3pp::command st_upd_after(db, R"EOS(
+        UPDATE entries SET
+            is_alive = 0,
+            mtime = :mtime,
+            digest = :digest,
+            dev = :dev,
+            ino = :ino,
+            digest_mode = :digest_mode,
+            chunking = :chunking,
+            digest_state = :digest_state,
+            block_digest_size = :block_digest_size,
+            deferred = NULL,
+            checkpoint_mtime = NULL,
+            checkpoint_block = NULL,
+            checkpoint_state = NULL
+        WHERE
+            rowid = :id
+    )EOS");
+
+    // digest of another link to the same inode is reused
+    sqlite3pp::command st_upd_link(db, R"EOS(
+        UPDATE entries SET
+            is_alive = 0,
+            mtime = :mtime,
+            digest = (SELECT digest FROM entries WHERE rowid = :src_id),
+            dev = :dev,
+            ino = :ino,
+            digest_mode = (SELECT digest_mode FROM entries WHERE rowid = :src_id),
+            chunking = (SELECT chunking FROM entries WHERE rowid = :src_id),
+            digest_state = (SELECT digest_state FROM entries WHERE rowid = :src_id),
+            block_digest_size = (SELECT block_digest_size FROM entries WHERE rowid = :src_id),
+            deferred = NULL,
+            checkpoint_mtime = NULL,
+            checkpoint_block = NULL,
+            checkpoint_state = NULL
+        WHERE
+            rowid = :id
+    )EOS");
+
+    // hashing of file is interrupted, its digest is NULL until it is resumed
+    sqlite3pp::command st_upd_checkpoint(db, R"EOS(
+        UPDATE entries SET
+            checkpoint_mtime = :mtime,
+            checkpoint_block = :block_no,
+            checkpoint_state = :state,
+            dev = :dev,
+            ino = :ino,
+            digest_mode = :digest_mode,
+            block_digest_size = :block_digest_size
+        WHERE
+            rowid = :id
+    )EOS");
+
+    sqlite3pp::query st_sel_checkpoint(db, R"EOS(
+        SELECT
+            checkpoint_state,
+            (SELECT digest FROM blocks_digests WHERE entry_id = :id AND block_no = checkpoint_block)
+        FROM
+            entries
+        WHERE
+            rowid = :id
+    )EOS");
+
+    // digest state of grown file and digest of its last full block
+    sqlite3pp::query st_sel_resume(db, R"EOS(
+        SELECT
+            digest_state,
+            (SELECT digest FROM blocks_digests WHERE entry_id = :id AND block_no = :block_no)
+        FROM
+            entries
+        WHERE
+            rowid = :id
+    )EOS");
+
+    sqlite3pp::query st_sel_blk(db, R"EOS(
+        SELECT
+            digest
+        FROM
+            blocks_digests
+        WHERE
+            entry_id = :entry_id
+            AND block_no = :block_no
+    )EOS");
+
+    sqlite3pp::command st_blk_copy(db, R"EOS(
+        INSERT INTO blocks_digests (
+            entry_id, block_no, digest, offset, length
+        ) SELECT
+            :entry_id, block_no, digest, offset, length
+        FROM
+            blocks_digests
+        WHERE
+            entry_id = :src_id
+    )EOS");
+
+	sqlite3pp::command st_blk_ins(db, R"EOS(
+        INSERT INTO blocks_digests (
+            entry_id, block_no, digest, offset, length
+        ) VALUES (
+            :entry_id, :block_no, :digest, :offset, :length)
+	)EOS");
+
+	sqlite3pp::command st_blk_upd(db, R"EOS(
+		UPDATE blocks_digests SET
+            digest = :digest,
+            offset = :offset,
+            length = :length
+		WHERE
+            entry_id = :entry_id
+            AND block_no = :block_no
+	)EOS");
+
+    sqlite3pp::command st_blk_del(db, R"EOS(
+        DELETE FROM blocks_digests
+        WHERE
+            entry_id = :entry_id
+            AND block_no > :block_no
+    )EOS");
+
+    sqlite3pp::command st_chg_ins(db, R"EOS(
+        INSERT INTO changes (
+            entry_id, parent_id, name, kind
+        ) VALUES (
+            :entry_id, :parent_id, :name, :kind)
+    )EOS");
+
+    std::unordered_map<std::string, uint64_t> parents;
+
+    // hardlinked files whose digest is current in this scan, (st_dev, st_ino)
+    // to entry id and mtime, st_dev isn't stable between mounts so the map
+    // isn't persistent
+    std::map<std::pair<uint64_t, uint64_t>, std::pair<uint64_t, uint64_t>> links;
+
+    auto journal = [&] (
+        uint64_t entry_id,
+        uint64_t parent_id,
+        const std::string & name,
+        entry_change::kind_type kind)
+    {
+        st_chg_ins.bind("entry_id", entry_id);
+        st_chg_ins.bind("parent_id", parent_id);
+        st_chg_ins.bind("name", name, sqlite3pp::nocopy);
+        st_chg_ins.bind("kind", int(kind));
+        st_chg_ins.execute();
+    };
+
+    typedef std::vector<uint8_t> blob;
+
+    // zero length is fixed block
+    auto update_block_digest = [&] (
+        uint64_t entry_id,
+        uint64_t blk_no,
+        const uint8_t * block_digest,
+        size_t digest_size,
+        uint64_t offset,
+        uint64_t length)
+    {
+        auto bind = [&] (auto & st) {
+            st.bind("entry_id", entry_id);
+            st.bind("block_no", blk_no);
+            st.bind("digest", (const void *) block_digest,
+                int(std::min(digest_size, block_digest_size_)), sqlite3pp::nocopy);
+
+            if( length == 0 ) {
+                st.bind("offset", nullptr);
+                st.bind("length", nullptr);
+            }
+            else {
+                st.bind("offset", offset);
+                st.bind("length", length);
+            }
+        };
+
+        bind(st_blk_ins);
+
+        auto exceptions_safe = db.exceptions();
+        at_scope_exit( db.exceptions(exceptions_safe) );
+        db.exceptions(false);
+
+        if( st_blk_ins.execute() == SQLITE_CONSTRAINT_UNIQUE ) {
+            db.exceptions(true);
+            bind(st_blk_upd);
+            st_blk_upd.execute();
+        }
+    };
+
+    // entry as it is stored before update
+    struct stored_entry {
+        uint64_t id = 0;
+        uint64_t mtime = 0;
+        // size of file whose digest is of current mode and of fixed blocks
+        uint64_t digested_size = 0;
+        uint64_t ino = 0;
+        // state of digest for appends is stored
+        bool resumable = false;
+        // interrupted hashing of file of this mtime of current mode and of
+        // fixed blocks may be resumed after checkpoint_block blocks
+        uint64_t checkpoint_mtime = 0;
+        uint64_t checkpoint_block = 0;
+    };
+
+    // if mtime of file is changed unchanged(stored) may tell its content is
+    // the same, digest is kept then and stored mtime is the new one
+	auto update_entry = [&] (
+        uint64_t parent_id,
+		const std::string & name,
+		bool is_dir,
+        uint64_t mtime,
+        uint64_t file_size,
+        uint64_t block_size,
+        stored_entry * p_stored = nullptr,
+        const std::function<bool (const stored_entry & stored)> & unchanged = nullptr)
+	{
+		auto bind = [&] (auto & st) {
+            st.bind("parent_id", parent_id);
+            st.bind("name", name, sqlite3pp::nocopy);
+
+			if( is_dir )
+                st.bind("is_dir", is_dir);
+			else
+                st.bind("is_dir", nullptr);
+
+            if( file_size == 0 )
+                st.bind("file_size", nullptr);
+            else
+                st.bind("file_size", file_size);
+
+            if( block_size == 0 )
+                st.bind("block_size", nullptr);
+            else
+                st.bind("block_size", block_size);
+        };
+		
+        auto exceptions_safe = db.exceptions();
+        at_scope_exit( db.exceptions(exceptions_safe) );
+
+        st_sel.bind("parent_id", parent_id);
+        st_sel.bind("name", name, sqlite3pp::nocopy);
+        st_sel.bind("digest_mode", int(digest_mode_));
+        st_sel.bind("chunking", chunking, sqlite3pp::nocopy);
+        st_sel.bind("block_size", block_size);
+        st_sel.bind("block_digest_size", uint64_t(block_digest_size_));
+
+        stored_entry stored;
+
+        auto get_id_mtim = [&] {
+            auto i = st_sel.begin();
+
+            if( i ) {
+                stored.id = i->get<uint64_t>("rowid");
+                stored.mtime = i->get<uint64_t>("mtime");
+                stored.digested_size = i->get<uint64_t>("digested_size");
+                stored.ino = i->get<uint64_t>("ino");
+                stored.resumable = i->get<int>("resumable") != 0;
+                stored.checkpoint_mtime = i->get<uint64_t>("checkpoint_mtime");
+                stored.checkpoint_block = i->get<uint64_t>("checkpoint_block");
+            }
+        };
+
+        db.exceptions(true);
+        get_id_mtim();
+
+        auto & id = stored.id;
+        auto kind = entry_change::kind_type(0);
+
+        // then mtime not changed, just touch entry
+        if( modified_only_ && id != 0 && (stored.mtime == mtime || mtime == 0) ) {
+            st_upd_touch.bind("id", id);
+            st_upd_touch.execute();
+        }
+        // digest is kept and queued for verification
+        else if( modified_only_ && id != 0 && unchanged && unchanged(stored) ) {
+            st_upd_defer.bind("id", id);
+            st_upd_defer.bind("mtime", mtime);
+            st_upd_defer.execute();
+
+            stored.mtime = mtime;
+            kind = entry_change::modified;
+        }
+        else {
+            db.exceptions(false);
+            bind(st_ins);
+
+            if( st_ins.execute() == SQLITE_CONSTRAINT_UNIQUE ) {
+                db.exceptions(true);
+                bind(st_upd);
+                st_upd.execute();
+
+                // changes of directory are journaled by its entries
+                if( !is_dir )
+                    kind = entry_change::modified;
+            }
+            else
+                kind = entry_change::created;
+        }
+
+        db.exceptions(true);
+
+        if( p_stored != nullptr )
+            *p_stored = stored;
+
+        if( id == 0 )
+            get_id_mtim();
+
+        if( kind != 0 && id != 0 )
+            journal(id, parent_id, name, kind);
+
+        return id;
+    };
+
+    // file digest of digest_mode_, sequential one is fed by blocks and
+    // Merkle one by digests of blocks or chunks
+    struct file_digest {
+        digest_mode_type mode;
+        cdc512 ctx;
+        cdc512_tree tree;
+        // state after the last full block is kept for appends
+        bool keep_state = false;
+        bool state_saved = false;
+        blob state;
+        // blocks hashed into loaded state, the last one must be unchanged
+        uint64_t resumed = 0;
+        blob resumed_digest;
+        bool diverged = false;
+
+        // state of blocks hashed so far
+        void save(blob & saved) const {
+            if( mode == merkle_digest ) {
+                tree.save(saved);
+            }
+            else {
+                saved.resize(cdc512::state_size);
+                ctx.save(&saved[0]);
+            }
+        }
+
+        void save() {
+            save(state);
+            state_saved = true;
+        }
+
+        // state must be of blocks full blocks
+        bool load(const blob & saved, uint64_t blocks, size_t block_size) {
+            if( mode == merkle_digest )
+                return tree.load(saved.data(), saved.size()) && tree.leaves() == blocks;
+
+            return ctx.load(saved.data(), saved.size(), blocks * block_size);
+        }
+
+        file_digest(digest_mode_type mode) : mode(mode) {}
+
+        void block(const uint8_t * block, size_t block_size) {
+            if( mode == sequential_digest )
+                ctx.update(block, block_size);
+        }
+
+        void leaf(const uint8_t * block_digest) {
+            if( mode == merkle_digest )
+                tree.add(block_digest);
+        }
+
+        void finish(blob & digest) {
+            if( keep_state && !state_saved )
+                save();
+
+            if( mode == merkle_digest )
+                tree.finish(digest);
+            else
+                ctx.finish(digest);
+        }
+    };
+
+    // feeds file_ctx with blocks of file read by br.read_runs(source...) and
+    // calls on_block(blk_no, block_digest, digest_size, offset, length) for
+    // every fixed block (length is zero then) or content defined chunk,
+    // stops if it returns false, fixed blocks of run are hashed by several
+    // at once
+    auto read_blocks = [&] (
+        block_reader & br,
+        file_digest & file_ctx,
+        const auto & on_block,
+        const auto & ... source)
+    {
+        auto blocks = [&] (const uint8_t * data, size_t count) {
+            constexpr size_t group = 8;
+            const uint8_t * group_data[group];
+            uint8_t group_digests[group][sizeof(cdc512_data)];
+            uint64_t blk_no = br.blocks_ - count;
+
+            for( size_t i = 0; i < count; i += group ) {
+                size_t n = std::min(group, count - i);
+
+                for( size_t j = 0; j < n; j++ )
+                    group_data[j] = data + (i + j) * br.block_size_;
+
+                cdc512::hash_many(group_data, n, br.block_size_, group_digests[0]);
+
+                for( size_t j = 0; j < n; j++ ) {
+                    // blocks in loaded state aren't hashed again, the last
+                    // of them must be unchanged for the file to be appended
+                    if( ++blk_no <= file_ctx.resumed ) {
+                        if( blk_no == file_ctx.resumed && (file_ctx.resumed_digest.empty()
+                                || std::memcmp(group_digests[j], file_ctx.resumed_digest.data(),
+                                    std::min(file_ctx.resumed_digest.size(), sizeof(group_digests[j]))) != 0) ) {
+                            file_ctx.diverged = true;
+                            return false;
+                        }
+
+                        continue;
+                    }
+
+                    if( !on_block(blk_no, group_digests[j], sizeof(group_digests[j]), 0, 0) )
+                        return false;
+
+                    // partial block is the last one
+                    if( file_ctx.keep_state && !file_ctx.state_saved && blk_no * br.block_size_ > br.bytes_ )
+                        file_ctx.save();
+
+                    file_ctx.block(group_data[j], br.block_size_);
+                    file_ctx.leaf(group_digests[j]);
+                }
+            }
+
+            return true;
+        };
+
+        if( chunk_avg_size_ == 0 )
+            return br.read_runs(source..., blocks);
+
+        content_chunker chunker(chunk_min_size_, chunk_avg_size_, chunk_max_size_);
+        // head of chunk from previous runs
+        blob carry;
+        uint64_t blk_no = 0, offset = 0;
+
+        auto chunk = [&] (const uint8_t * data, size_t length) {
+            cdc512 ctx(data, data + length);
+
+            if( !on_block(++blk_no, ctx.digest, sizeof(ctx.digest), offset, length) )
+                return false;
+
+            file_ctx.leaf(ctx.digest);
+            offset += length;
+            return true;
+        };
+
+        auto chunks = [&] (const uint8_t * data, size_t count) {
+            for( size_t i = 0; i < count; i++ )
+                file_ctx.block(data + i * br.block_size_, br.block_size_);
+
+            // padding of the last block isn't content
+            size_t size = count * br.block_size_ - size_t(br.blocks_ * br.block_size_ - br.bytes_);
+
+            while( size != 0 ) {
+                bool cut;
+                size_t n = chunker.scan(data, size, cut);
+
+                if( cut && carry.empty() ) {
+                    if( !chunk(data, n) )
+                        return false;
+                }
+                else {
+                    carry.insert(carry.end(), data, data + n);
+
+                    if( cut ) {
+                        if( !chunk(&carry[0], carry.size()) )
+                            return false;
+
+                        carry.clear();
+                    }
+                }
+
+                data += n;
+                size -= n;
+            }
+
+            return true;
+        };
+
+        if( !br.read_runs(source..., chunks) )
+            return false;
+
+        return carry.empty() || chunk(&carry[0], carry.size());
+    };
+
+    // blocks beyond the end of shrunk file
+    auto delete_blocks_after = [&] (uint64_t entry_id, uint64_t blocks) {
+        st_blk_del.bind("entry_id", entry_id);
+        st_blk_del.bind("block_no", blocks);
+        st_blk_del.execute();
+    };
+
+    size_t block_size = 4096;
+
+    // block size of file of size bytes, content defined chunks are found in
+    // blocks of minimal size
+    auto file_block_size = [&] (uint64_t size) {
+        size_t bs = block_size;
+
+        if( chunking.empty() )
+            while( bs * 2 <= max_block_size_ && size > bs * 4096 )
+                bs *= 2;
+
+        return bs;
+    };
+
+    auto new_reader = [&] {
+        block_reader br;
+        br.block_size_ = block_size;
+        br.mmap_threshold_ = mmap_threshold_;
+
+        if( uncached_ ) {
+            br.read_size_ = 4 * 1024 * 1024;
+            br.direct_io_ = direct_io_;
+            br.drop_cache_ = true;
+        }
+
+        return br;
+    };
+
+    // blocks sampled by pre-check besides the first and the last ones
+    constexpr uint64_t precheck_samples = 6;
+    std::minstd_rand precheck_random;
+    block_reader sample_reader;
+
+    // digests of the first, the last and some random blocks between them are
+    // equal to stored ones, blocks are chosen by identity and stamp of file,
+    // so the same file state is always sampled the same way
+    auto sampled_unchanged = [&] (
+        const string & path_name,
+        uint64_t entry_id,
+        uint64_t size,
+        uint64_t dev,
+        uint64_t ino,
+        uint64_t mtime)
+    {
+        const size_t bs = sample_reader.block_size_ = file_block_size(size);
+        uint64_t blocks = (size + bs - 1) / bs;
+        std::vector<uint64_t> samples = { 1, blocks };
+
+        std::seed_seq seed = {
+            uint32_t(dev), uint32_t(dev >> 32), uint32_t(ino), uint32_t(ino >> 32),
+            uint32_t(size), uint32_t(size >> 32), uint32_t(mtime), uint32_t(mtime >> 32)
+        };
+        precheck_random.seed(seed);
+
+        for( uint64_t i = 0; i < precheck_samples && blocks > 2; i++ )
+            samples.push_back(2 + precheck_random() % (blocks - 2));
+
+        for( auto blk_no : samples ) {
+            blob stored;
+
+            st_sel_blk.bind("entry_id", entry_id);
+            st_sel_blk.bind("block_no", blk_no);
+
+            auto i = st_sel_blk.begin();
+
+            if( i && i->column_bytes(0) != 0 ) {
+                auto digest = static_cast<const uint8_t *>(i->get<const void *>(0));
+                stored.assign(digest, digest + i->column_bytes(0));
+            }
+
+            st_sel_blk.reset();
+
+            bool equal = false;
+
+            // only one block is read
+            auto block = [&] (const uint8_t * data) {
+                cdc512 ctx(data, data + bs);
+
+                equal = !stored.empty() && std::memcmp(ctx.digest, stored.data(),
+                    std::min(stored.size(), sizeof(ctx.digest))) == 0;
+
+                return false;
+            };
+
+            sample_reader.offset_ = (blk_no - 1) * bs;
+            sample_reader.read(path_name, block);
+
+            if( !equal )
+                return false;
+        }
+
+        return true;
+    };
+
+    struct hash_job {
+        uint64_t entry_id;
+        uint64_t parent_id;
+        std::string utf_name;
+        string path_name;
+        uint64_t mtime;
+        uint64_t size;
+        uint64_t dev;
+        uint64_t ino;
+        uint32_t nlink;
+        uint64_t physical;
+        // grown file is hashed on from this many full blocks, see file_digest
+        uint64_t resume = 0;
+        blob resume_state = {};
+        blob resume_digest = {};
+    };
+
+    // file digest of job, reader is positioned at the last block of loaded
+    // state if job is append
+    auto new_file_digest = [&] (const hash_job & job, block_reader & br) {
+        file_digest ctx = { digest_mode_ };
+        br.block_size_ = file_block_size(job.size);
+        br.offset_ = 0;
+
+        // file may have grown while it was hashed, so state may be of more
+        // blocks than stored size has
+        if( job.resume != 0 && ctx.load(job.resume_state, job.resume, br.block_size_) ) {
+            ctx.resumed = job.resume;
+            ctx.resumed_digest = job.resume_digest;
+            br.offset_ = (job.resume - 1) * br.block_size_;
+        }
+        else {
+            ctx = file_digest { digest_mode_ };
+        }
+
+        ctx.keep_state = detect_appends_ && chunking.empty();
+        return ctx;
+    };
+
+    auto store_digest = [&] (const hash_job & job, const blob & digest, const blob & state) {
+        st_upd_after.bind("id", job.entry_id);
+        st_upd_after.bind("mtime", job.mtime);
+        st_upd_after.bind("digest", digest, sqlite3pp::nocopy);
+
+        if( state.empty() )
+            st_upd_after.bind("digest_state", nullptr);
+        else
+            st_upd_after.bind("digest_state", state, sqlite3pp::nocopy);
+
+        st_upd_after.bind("dev", job.dev);
+        st_upd_after.bind("ino", job.ino);
+        st_upd_after.bind("digest_mode", int(digest_mode_));
+        st_upd_after.bind("block_digest_size", uint64_t(block_digest_size_));
+
+        if( chunking.empty() )
+            st_upd_after.bind("chunking", nullptr);
+        else
+            st_upd_after.bind("chunking", chunking, sqlite3pp::nocopy);
+        st_upd_after.execute();
+
+        journal(job.entry_id, job.parent_id, job.utf_name, entry_change::digested);
+
+        if( job.nlink > 1 )
+            links[std::make_pair(job.dev, job.ino)] = std::make_pair(job.entry_id, job.mtime);
+    };
+
+    // blocks of file hashed before blk_no are stored with state of digest of
+    // them every checkpoint_size_ bytes and at shutdown, fixed blocks only
+    auto checkpoint_due = [&] (const file_digest & ctx, const block_reader & br, uint64_t blk_no) {
+        if( checkpoint_size_ == 0 || !chunking.empty() || blk_no - 1 <= ctx.resumed )
+            return false;
+
+        if( p_shutdown != nullptr && *p_shutdown )
+            return true;
+
+        return (blk_no - 1) % std::max(uint64_t(1), uint64_t(checkpoint_size_ / br.block_size_)) == 0;
+    };
+
+    auto store_checkpoint = [&] (const hash_job & job, uint64_t blocks, const blob & state) {
+        st_upd_checkpoint.bind("id", job.entry_id);
+        st_upd_checkpoint.bind("mtime", job.mtime);
+        st_upd_checkpoint.bind("block_no", blocks);
+        st_upd_checkpoint.bind("state", state, sqlite3pp::nocopy);
+        st_upd_checkpoint.bind("dev", job.dev);
+        st_upd_checkpoint.bind("ino", job.ino);
+        st_upd_checkpoint.bind("digest_mode", int(digest_mode_));
+        st_upd_checkpoint.bind("block_digest_size", uint64_t(block_digest_size_));
+        st_upd_checkpoint.execute();
+    };
+
+    // reuses digests of another link to the same inode if they are current
+    auto link_file = [&] (const hash_job & job) {
+        auto link = job.nlink > 1 ? links.find(std::make_pair(job.dev, job.ino)) : links.end();
+
+        if( link == links.end() || link->second.second != job.mtime )
+            return false;
+
+        auto src_id = link->second.first;
+
+        delete_blocks_after(job.entry_id, 0);
+
+        st_blk_copy.bind("entry_id", job.entry_id);
+        st_blk_copy.bind("src_id", src_id);
+        st_blk_copy.execute();
+
+        st_upd_link.bind("id", job.entry_id);
+        st_upd_link.bind("src_id", src_id);
+        st_upd_link.bind("mtime", job.mtime);
+        st_upd_link.bind("dev", job.dev);
+        st_upd_link.bind("ino", job.ino);
+        st_upd_link.execute();
+
+        journal(job.entry_id, job.parent_id, job.utf_name, entry_change::digested);
+
+        return true;
+    };
+
+    // pipelined engine, entries (in full mode) are emitted by traversal
+    // thread, files are read and hashed by pool of threads_ threads and this
+    // thread is the only one touching database, stages are connected by
+    // bounded queues, full queue stalls the stage feeding it
+    struct scan_item {
+        string path;
+        string name;
+        string path_name;
+        uintptr_t level;
+        bool is_dir;
+        bool is_reg;
+        uint64_t mtime;
+        uint64_t fsize;
+        uint64_t dev;
+        uint64_t ino;
+        uint32_t nlink;
+    };
+
+    // block digests of file from first_block on, the last message of file
+    // carries its job and digest
+    struct hash_result {
+        hash_job job;
+        uint64_t first_block = 1;
+        blob digests;
+        // offsets and lengths of content defined chunks
+        std::vector<std::pair<uint64_t, uint64_t>> spans;
+        uint64_t blocks = 0;
+        blob digest;
+        blob state;
+        // digests of blocks before checkpoint_block are all sent
+        uint64_t checkpoint_block = 0;
+        blob checkpoint_state;
+        bool last = false;
+        bool ok = false;
+    };
+
+    // block digests per message
+    constexpr size_t chunk_blocks = 256;
+    // database operations per transaction
+    constexpr uintptr_t batch_ops = 4096;
+
+    const bool pipelined = threads_ > 0;
+
+    bounded_queue<scan_item> q_entries(pipelined ? 4096 : 0);
+    bounded_queue<hash_job> q_jobs(pipelined ? threads_ * 4 : 0);
+    bounded_queue<hash_result> q_results(pipelined ? threads_ * 16 : 0);
+
+    std::atomic<bool> entries_done(false), aborted(false);
+    std::mutex error_mtx;
+    std::exception_ptr error;
+
+    auto fail = [&] {
+        std::unique_lock<std::mutex> lk(error_mtx);
+
+        if( error == nullptr )
+            error = std::current_exception();
+
+        aborted = true;
+    };
+
+    auto check_error = [&] {
+        if( aborted ) {
+            std::unique_lock<std::mutex> lk(error_mtx);
+
+            if( error != nullptr )
+                std::rethrow_exception(error);
+        }
+    };
+
+    // hashes file of job read by br.read_runs(source...) and passes its block
+    // digests to push(r) by messages of chunk_blocks, checkpoints are sent as
+    // they are due, the last message carries digest of file, hashing stops
+    // if push returns false
+    auto hash_blocks = [&] (hash_job & job, block_reader & br, const auto & push, const auto & ... source) {
+        hash_result r;
+        r.job.entry_id = job.entry_id;
+
+        auto ctx = new_file_digest(job, br);
+        uint64_t blocks = ctx.resumed;
+
+        auto on_block = [&] (
+            uint64_t blk_no,
+            const uint8_t * block_digest,
+            size_t digest_size,
+            uint64_t offset,
+            uint64_t length)
+        {
+            // checkpoint at shutdown is sent with the last result
+            if( checkpoint_due(ctx, br, blk_no) ) {
+                ctx.save(r.checkpoint_state);
+                r.checkpoint_block = blk_no - 1;
+
+                if( p_shutdown != nullptr && *p_shutdown )
+                    return false;
+
+                r.job = job;
+
+                if( !push(r) )
+                    return false;
+
+                r = hash_result();
+                r.job.entry_id = job.entry_id;
+            }
+            else if( p_shutdown != nullptr && *p_shutdown ) {
                 return false;
             }
 
-            if( r == 0 )
-                break;
+            if( r.digests.empty() )
+                r.first_block = blk_no;
+
+            r.digests.insert(r.digests.end(), block_digest, block_digest + digest_size);
+            blocks = blk_no;
+
+            if( length != 0 )
+                r.spans.emplace_back(offset, length);
+
+            if( r.digests.size() < chunk_blocks * digest_size )
+                return true;
+
+            if( !push(r) )
+                return false;
+
+            r = hash_result();
+            r.job.entry_id = job.entry_id;
+            return true;
+        };
+
+        bool ok = read_blocks(br, ctx, on_block, source...);
+
+        // file was rewritten rather than appended, nothing is sent yet
+        if( ctx.diverged ) {
+            job.resume = 0;
+            ctx = new_file_digest(job, br);
+            blocks = 0;
+            ok = read_blocks(br, ctx, on_block, source...);
+        }
+
+        if( aborted )
+            return;
+
+        if( ok ) {
+            ctx.finish(r.digest);
+            r.state = std::move(ctx.state);
+        }
+
+        r.job = std::move(job);
+        r.blocks = blocks;
+        r.last = true;
+        r.ok = ok;
+        push(r);
+    };
+
+    std::unique_ptr<sqlite3pp::transaction> xct;
+    uintptr_t xct_ops = 0;
+
+    // commit failure while unwinding must not throw from destructor
+    at_scope_exit(
+        if( xct != nullptr ) {
+            auto exceptions_safe = db.exceptions();
+            db.exceptions(false);
+            xct = nullptr;
+            db.exceptions(exceptions_safe);
+        }
+    );
+
+    auto commit = [&] {
+        if( xct != nullptr ) {
+            xct->commit();
+            xct = nullptr;
+        }
+
+        xct_ops = 0;
+    };
+
+    auto batched = [&] {
+        if( !pipelined )
+            return;
+
+        if( xct == nullptr )
+            xct.reset(new sqlite3pp::transaction(db));
+
+        if( ++xct_ops >= batch_ops )
+            commit();
+    };
+
+    // hash jobs sent to the pool and not applied yet
+    uintptr_t in_flight = 0;
+    // inodes being hashed by the pool to jobs of their other links waiting
+    // for the digest
+    std::map<std::pair<uint64_t, uint64_t>, std::vector<hash_job>> linking;
+
+    std::function<void(hash_job &)> hash_file;
+
+    // stores block digests, checkpoint and at last message digest of file
+    // carried by r, both engines apply their results by it
+    auto store_result = [&] (hash_result & r) {
+        const auto digest_size = sizeof(cdc512_data);
+        auto blk_no = r.first_block;
+
+        for( size_t i = 0, j = 0; i + digest_size <= r.digests.size(); i += digest_size, j++ )
+            if( r.spans.empty() )
+                update_block_digest(r.job.entry_id, blk_no++, &r.digests[i], digest_size, 0, 0);
+            else
+                update_block_digest(r.job.entry_id, blk_no++, &r.digests[i], digest_size,
+                    r.spans[j].first, r.spans[j].second);
+
+        if( !r.checkpoint_state.empty() ) {
+            store_checkpoint(r.job, r.checkpoint_block, r.checkpoint_state);
+            commit();
+        }
+
+        batched();
+
+        if( !r.last )
+            return;
+
+        delete_blocks_after(r.job.entry_id, r.blocks);
+
+        if( r.ok )
+            store_digest(r.job, r.digest, r.state);
+    };
+
+    auto apply_result = [&] (hash_result & r) {
+        store_result(r);
+
+        if( !r.last )
+            return;
+
+        in_flight--;
+
+        if( r.job.nlink > 1 ) {
+            auto l = linking.find(std::make_pair(r.job.dev, r.job.ino));
+
+            if( l != linking.end() ) {
+                auto waiting = std::move(l->second);
+                linking.erase(l);
+
+                for( auto & job : waiting )
+                    hash_file(job);
+            }
+        }
+    };
+
+    auto drain_results = [&] {
+        bool any = false;
+        hash_result r;
+
+        while( q_results.try_pop(r) ) {
+            apply_result(r);
+            any = true;
+        }
+
+        return any;
+    };
+
+    // waits until the pool hashed all jobs sent to it
+    auto drain_pool = [&] {
+        backoff idle;
+
+        while( in_flight != 0 ) {
+            check_error();
+
+            // hashers stop at shutdown, their results carry checkpoints
+            if( p_shutdown != nullptr && *p_shutdown && checkpoint_size_ == 0 )
+                return;
+
+            if( drain_results() )
+                idle.reset();
+            else
+                idle();
+        }
+    };
+
+    auto hasher = [&] {
+        try {
+            auto reader = new_reader();
+            backoff idle;
+            hash_job job;
+
+            auto push = [&] (hash_result & r) {
+                while( !q_results.try_push(r) ) {
+                    if( aborted )
+                        return false;
+
+                    idle();
+                }
+
+                return true;
+            };
+
+#if HAVE_IO_URING
+            // small files read in flight together, tag is index in batch
+            std::unique_ptr<uring_file_reader> uring;
+            std::vector<hash_job> batch;
+
+            if( uring_depth_ != 0 ) {
+                try {
+                    uring.reset(new uring_file_reader(unsigned(uring_depth_), 64 * 1024));
+                }
+                catch( const std::runtime_error & ) {
+                    // io_uring is disabled or not supported by kernel
+                }
+            }
+
+            auto on_file = [&] (uint64_t tag, const uint8_t * data, size_t size) {
+                if( data == nullptr )
+                    hash_blocks(batch[tag], reader, push, batch[tag].path_name);
+                else
+                    hash_blocks(batch[tag], reader, push, data, size);
+            };
+
+            auto run_batch = [&] {
+                uring->run(on_file);
+                batch.clear();
+            };
+#endif
+            // uncached, the next job is taken in advance to read ahead its file
+            hash_job next;
+            bool has_next = false;
+
+            // stopped at exit of reindex
+            while( !aborted ) {
+                if( has_next ) {
+                    job = std::move(next);
+                    has_next = false;
+                }
+                else if( !q_jobs.try_pop(job) ) {
+#if HAVE_IO_URING
+                    // no more files at the moment
+                    if( !batch.empty() ) {
+                        run_batch();
+                        continue;
+                    }
+#endif
+                    idle();
+                    continue;
+                }
+
+                idle.reset();
+#if HAVE_IO_URING
+                if( uring != nullptr && job.size < uring->file_size() ) {
+                    uring->add(job.path_name, batch.size());
+                    batch.emplace_back(std::move(job));
+
+                    // several files per slot, so slots are refilled at once
+                    if( batch.size() >= uring->depth() * 4 )
+                        run_batch();
+
+                    continue;
+                }
+#endif
+                if( uncached_ && q_jobs.try_pop(next) ) {
+                    reader.prefetch(next.path_name);
+                    has_next = true;
+                }
+
+                hash_blocks(job, reader, push, job.path_name);
+            }
+        }
+        catch( ... ) {
+            fail();
+        }
+    };
+
+    std::vector<std::thread> threads;
 
-            if( size_t(r) < block_size )
-                std::memset(&buf[r], 0, block_size - r);
+    at_scope_exit(
+        aborted = true;
 
-            blob block_digest;
-            cdc512 blk_ctx(block_digest, buf.cbegin(), buf.cend());
-            update_block_digest(entry_id, blk_no, block_digest);
+        for( auto & t : threads )
+            t.join();
+    );
 
-            st_blk_del.bind("entry_id", entry_id);
-            st_blk_del.bind("block_no", blk_no);
-            st_blk_del.execute();
+    if( pipelined )
+        for( uintptr_t i = 0; i < threads_; i++ )
+            threads.emplace_back(hasher);
 
-            file_ctx.update(buf.cbegin(), buf.cend());
+    // reader of serial engine
+    auto reader = new_reader();
+
+    hash_file = [&] (hash_job & job) {
+        if( link_file(job) ) {
+            batched();
+            return;
         }
 
-        return true;
-    };
+        // serial engine applies messages at once
+        if( !pipelined ) {
+            auto apply = [&] (hash_result & r) {
+                store_result(r);
+                return true;
+            };
 
-    directory_reader dr;
-    dr.recursive_ = dr.list_directories_ = true;
-    dr.manipulator_ = [&] {
-        if( p_shutdown != nullptr && *p_shutdown ) {
-            dr.abort_ = true;
+            hash_blocks(job, reader, apply, job.path_name);
             return;
         }
 
-        // skip inaccessible files or directories
-        if( access(dr.path_name_, R_OK | (dr.is_dir ? X_OK : 0)) != 0 )
-            return;
+        // the other link is being hashed, its digest is reused
+        if( job.nlink > 1 ) {
+            auto l = linking.emplace(std::make_pair(job.dev, job.ino), std::vector<hash_job>());
+
+            if( !l.second ) {
+                l.first->second.emplace_back(std::move(job));
+                return;
+            }
+        }
+
+        in_flight++;
+
+        backoff idle;
+
+        // applying results while the pool is stalled on full results queue
+        while( !q_jobs.try_push(job) ) {
+            check_error();
+
+            if( drain_results() )
+                idle.reset();
+            else
+                idle();
+        }
+    };
+
+    // extent order, modified files of directory being listed
+    std::vector<hash_job> pending;
+    string pending_path;
+
+    auto flush_pending = [&] {
+        std::sort(pending.begin(), pending.end(), [] (const hash_job & a, const hash_job & b) {
+            return a.physical < b.physical || (a.physical == b.physical && a.ino < b.ino);
+        });
+
+        for( size_t i = 0; i < pending.size(); i++ ) {
+            if( p_shutdown != nullptr && *p_shutdown )
+                break;
+
+            if( uncached_ && !pipelined && i + 1 < pending.size() )
+                reader.prefetch(pending[i + 1].path_name);
+
+            hash_file(pending[i]);
+        }
 
-        auto utf_name = str2utf(dr.name_);
-        auto utf_path = str2utf(dr.path_);
+        pending.clear();
+    };
+
+    // job resumes after blocks whose digest state and the last block digest
+    // are selected by bound st, if they are found
+    auto load_resume = [&] (hash_job & job, sqlite3pp::query & st, uint64_t blocks) {
+        auto i = st.begin();
+
+        if( i && i->column_bytes(0) != 0 && i->column_bytes(1) != 0 ) {
+            auto state = static_cast<const uint8_t *>(i->get<const void *>(0));
+            auto digest = static_cast<const uint8_t *>(i->get<const void *>(1));
+
+            job.resume = blocks;
+            job.resume_state.assign(state, state + i->column_bytes(0));
+            job.resume_digest.assign(digest, digest + i->column_bytes(1));
+        }
+
+        st.reset();
+    };
+
+    auto process_entry = [&] (const scan_item & e) {
+        auto utf_name = str2utf(e.name);
+        auto utf_path = str2utf(e.path);
 
         uint64_t parent_id = [&] {
             auto pit = parents.find(utf_path);
 
 			if( pit == parents.cend() ) {
-                if( dr.level_ > 1 )
+                if( e.level > 1 )
 					throw std::runtime_error("Undefined behavior");
 
                 auto id = update_entry(0, utf_path, true, 0, 0, 0, 0);
@@ -938,40 +2714,611 @@ void directory_indexer::reindex(
             return pit->second;
         }();
 
-        size_t block_size = 4096;
+        // content of large file whose mtime changed but size didn't is
+        // sampled first, full verification is deferred if it is the same
+        std::function<bool (const stored_entry & stored)> unchanged;
 
-        uint64_t mtim, fmtim = dr.mtime * 1000000000 + dr.mtime_ns;
+        if( e.is_reg && precheck_size_ != 0 && e.fsize >= precheck_size_ && chunking.empty() )
+            unchanged = [&] (const stored_entry & stored) {
+                return stored.digested_size == e.fsize && stored.ino == e.ino
+                    && sampled_unchanged(e.path_name, stored.id, e.fsize, e.dev, e.ino, e.mtime);
+            };
+
+        const auto bs = file_block_size(e.fsize);
+
+        stored_entry stored;
         uint64_t entry_id = update_entry(
             parent_id,
             utf_name,
-            dr.is_dir,
-            fmtim,
-            dr.fsize,
-            block_size,
-            &mtim);
+            e.is_dir,
+            e.mtime,
+            e.fsize,
+            bs,
+            &stored,
+            unchanged);
 
-        if( dr.is_dir )
-            parents.emplace(std::make_pair(str2utf(dr.path_name_), entry_id));
+        batched();
+
+        if( e.is_dir )
+            parents.emplace(std::make_pair(str2utf(e.path_name), entry_id));
 
         // if file modified then calculate digests
 
-        if( dr.is_reg && (!modified_only_ || mtim != fmtim) ) {
-            cdc512 ctx;
+        if( !e.is_reg )
+            return;
 
-            if( update_blocks(ctx, dr.path_name_, entry_id, block_size) ) {
-                blob digest;
-                ctx.finish(digest);
+        if( modified_only_ && stored.mtime == e.mtime ) {
+            if( e.nlink > 1 )
+                links.emplace(std::make_pair(e.dev, e.ino), std::make_pair(entry_id, e.mtime));
 
-                st_upd_after.bind("id", entry_id);
-                st_upd_after.bind("mtime", fmtim);
-                st_upd_after.bind("digest", digest, sqlite3pp::nocopy);
-                st_upd_after.execute();
-            }
+            return;
+        }
+
+        hash_job job = {
+            entry_id, parent_id, utf_name, e.path_name, e.mtime, e.fsize, e.dev, e.ino, e.nlink, 0
+        };
+
+        // same file only grew, its last full block already hashed is checked
+        // and the rest is hashed on from saved state
+        if( detect_appends_ && chunking.empty() && stored.resumable && stored.digested_size >= bs
+            && e.fsize > stored.digested_size && stored.ino == e.ino ) {
+            st_sel_resume.bind("id", entry_id);
+            st_sel_resume.bind("block_no", stored.digested_size / bs);
+            load_resume(job, st_sel_resume, stored.digested_size / bs);
+        }
+        // interrupted hashing of the same file is resumed from checkpoint
+        else if( checkpoint_size_ != 0 && chunking.empty() && stored.checkpoint_block != 0
+            && stored.checkpoint_mtime == e.mtime && stored.ino == e.ino ) {
+            st_sel_checkpoint.bind("id", entry_id);
+            load_resume(job, st_sel_checkpoint, stored.checkpoint_block);
+        }
+
+        if( hash_order_ != extent_order ) {
+            hash_file(job);
+            return;
+        }
+
+        // directory is changed, files of previous one are all known
+        if( e.path != pending_path ) {
+            flush_pending();
+            pending_path = e.path;
+        }
+#if __linux__
+        job.physical = first_extent_offset(job.path_name);
+#endif
+        pending.emplace_back(std::move(job));
+    };
+
+    directory_reader dr;
+    dr.recursive_ = dr.list_directories_ = true;
+#if __linux__
+    dr.inode_order_ = hash_order_ != readdir_order;
+#endif
+
+    auto scan_entry = [&] {
+        return scan_item {
+            dr.path_, dr.name_, dr.path_name_, dr.level_, dr.is_dir, dr.is_reg,
+            dr.mtime * 1000000000 + dr.mtime_ns, dr.fsize, dr.dev, dr.ino, dr.nlink
+        };
+    };
+
+    dr.manipulator_ = [&] {
+        if( p_shutdown != nullptr && *p_shutdown ) {
+            dr.abort_ = true;
+            return;
         }
+
+        // skip inaccessible files or directories
+        if( !dr.accessible(R_OK | (dr.is_dir ? X_OK : 0)) )
+            return;
+
+        process_entry(scan_entry());
+
+        if( pipelined )
+            drain_results();
 	};
 	
-    dr.read(dir_path_name);
-		
+    // in incremental mode directory stamp is kept in mtime column of directory
+    // entry, it is stored only after whole listing of directory is processed
+    sqlite3pp::query st_sel_stamp(db, R"EOS(
+        SELECT
+            mtime
+        FROM
+            entries
+        WHERE
+            rowid = :id
+    )EOS");
+
+    sqlite3pp::query st_sel_dirs(db, R"EOS(
+        SELECT
+            rowid,
+            name
+        FROM
+            entries
+        WHERE
+            parent_id = :parent_id
+            AND is_dir IS NOT NULL
+    )EOS");
+
+    sqlite3pp::command st_upd_touch_children(db, R"EOS(
+        UPDATE entries SET
+            is_alive = 0
+        WHERE
+            parent_id = :parent_id
+    )EOS");
+
+    sqlite3pp::command st_upd_stamp(db, R"EOS(
+        UPDATE entries SET
+            mtime = :mtime
+        WHERE
+            rowid = :id
+    )EOS");
+
+    // in dirty mode children of listed directory are marked before listing,
+    // those not found by it are deleted with their subtrees
+    sqlite3pp::command st_upd_mark_children(db, R"EOS(
+        UPDATE entries SET
+            is_alive = 2
+        WHERE
+            parent_id = :parent_id
+    )EOS");
+
+    sqlite3pp::command st_del_stale_blocks(db, R"EOS(
+        WITH RECURSIVE stale(id) AS (
+            SELECT rowid FROM entries WHERE parent_id = :parent_id AND is_alive = 2
+            UNION ALL
+            SELECT e.rowid FROM entries e INNER JOIN stale ON e.parent_id = stale.id
+        )
+        DELETE FROM blocks_digests WHERE entry_id IN stale
+    )EOS");
+
+    sqlite3pp::command st_chg_stale(db, R"EOS(
+        WITH RECURSIVE stale(id) AS (
+            SELECT rowid FROM entries WHERE parent_id = :parent_id AND is_alive = 2
+            UNION ALL
+            SELECT e.rowid FROM entries e INNER JOIN stale ON e.parent_id = stale.id
+        )
+        INSERT INTO changes (entry_id, parent_id, name, kind)
+            SELECT rowid, parent_id, name, :kind FROM entries WHERE rowid IN stale
+    )EOS");
+
+    sqlite3pp::command st_del_stale(db, R"EOS(
+        WITH RECURSIVE stale(id) AS (
+            SELECT rowid FROM entries WHERE parent_id = :parent_id AND is_alive = 2
+            UNION ALL
+            SELECT e.rowid FROM entries e INNER JOIN stale ON e.parent_id = stale.id
+        )
+        DELETE FROM entries WHERE rowid IN stale
+    )EOS");
+
+    sqlite3pp::command st_upd_revive_children(db, R"EOS(
+        UPDATE entries SET
+            is_alive = 1
+        WHERE
+            parent_id = :parent_id
+    )EOS");
+
+    struct work_item {
+        string path;
+        uint64_t id;
+        uintptr_t level;
+        std::shared_ptr<const ignore_list> ignore;
+        // not indexed before, in dirty mode all its subdirectories are listed
+        bool fresh;
+    };
+
+    std::vector<work_item> work;
+    // child directories of listed directory indexed before listing
+    std::unordered_set<uint64_t> known;
+    bool spawn_all = true;
+
+    // subdirectories of listed directory are visited by the same loop
+    auto spawner = [&] {
+        auto pit = parents.find(str2utf(dr.path_name_));
+
+        // skipped as inaccessible
+        if( pit == parents.cend() )
+            return;
+
+        if( spawn_all || known.find(pit->second) == known.cend() )
+            work.push_back({ dr.path_name_, pit->second, dr.level_, dr.ignore_, true });
+    };
+
+    // the same root entry name as reader gives it
+    auto root = dir_path_name;
+
+    if( !root.empty() && root.back() == path_delimiter[0] )
+        root.pop_back();
+
+    auto root_entry = [&] {
+        auto utf_root = str2utf(root);
+        auto root_id = update_entry(0, utf_root, true, 0, 0, 0);
+        parents.emplace(std::make_pair(utf_root, root_id));
+        return root_id;
+    };
+
+    // stamps of listed directories whose files are still being hashed
+    std::vector<std::pair<uint64_t, uint64_t>> stamps;
+
+    auto store_stamp = [&] (uint64_t id, uint64_t stamp) {
+        // stamp of directory modified in the last seconds may not change
+        // on the next modification due to timestamp granularity
+        if( stamp / 1000000000 + 2 >= uint64_t(time(nullptr)) )
+            stamp = 0;
+
+        // directory must not be trusted before its files are digested
+        if( pipelined && in_flight != 0 ) {
+            stamps.emplace_back(id, stamp);
+            return;
+        }
+
+        st_upd_stamp.bind("id", id);
+
+        if( stamp == 0 )
+            st_upd_stamp.bind("mtime", nullptr);
+        else
+            st_upd_stamp.bind("mtime", stamp);
+
+        st_upd_stamp.execute();
+        batched();
+    };
+
+    // files deferred by pre-check and touched by this pass are hashed, of
+    // directory parent_id only unless it is zero, path of entry is joined
+    // from names of its ancestors up to root entry
+    uintptr_t verify_budget = verify_limit_;
+
+    auto verify_deferred = [&] (uint64_t parent_id) {
+        if( verify_budget == 0 )
+            return;
+
+        sqlite3pp::query st(db, R"EOS(
+            WITH RECURSIVE up(id, entry_id, path) AS (
+                SELECT parent_id, rowid, name FROM (
+                    SELECT
+                        rowid, parent_id, name
+                    FROM
+                        entries
+                    WHERE
+                        deferred IS NOT NULL
+                        AND is_alive = 0
+                        AND (:parent_id = 0 OR parent_id = :parent_id)
+                    ORDER BY
+                        rowid
+                    LIMIT :limit
+                )
+                UNION ALL
+                SELECT
+                    e.parent_id, up.entry_id, e.name || :delimiter || up.path
+                FROM
+                    entries e JOIN up ON e.rowid = up.id
+            )
+            SELECT
+                up.entry_id,
+                e.parent_id,
+                e.name,
+                up.path,
+                e.mtime,
+                e.file_size,
+                e.dev,
+                e.ino
+            FROM
+                up JOIN entries e ON e.rowid = up.entry_id
+            WHERE
+                up.id = 0
+        )EOS");
+
+        const auto delimiter = str2utf(string(path_delimiter));
+
+        st.bind("parent_id", parent_id);
+        st.bind("limit", uint64_t(verify_budget));
+        st.bind("delimiter", delimiter, sqlite3pp::nocopy);
+
+        std::vector<hash_job> jobs;
+
+        for( auto i = st.begin(); i != st.end(); ++i )
+            jobs.push_back(hash_job {
+                i->get<uint64_t>(0),
+                i->get<uint64_t>(1),
+                i->get<std::string>(2),
+                utf2str(i->get<std::string>(3)),
+                i->get<uint64_t>(4),
+                i->get<uint64_t>(5),
+                i->get<uint64_t>(6),
+                i->get<uint64_t>(7),
+                1,
+                0
+            });
+
+        st.reset();
+
+        if( verify_budget != ~uintptr_t(0) )
+            verify_budget -= jobs.size();
+
+        for( auto & job : jobs ) {
+            if( p_shutdown != nullptr && *p_shutdown )
+                return;
+
+            hash_file(job);
+        }
+    };
+
+    auto finish = [&] {
+        drain_pool();
+
+        if( p_shutdown != nullptr && *p_shutdown ) {
+            if( checkpoint_size_ != 0 )
+                commit();
+
+            return;
+        }
+
+        for( const auto & s : stamps )
+            store_stamp(s.first, s.second);
+
+        stamps.clear();
+        commit();
+    };
+
+    auto reindex_incremental = [&] {
+        dr.spawner_ = spawner;
+        work.push_back({ root, root_entry(), 0, dr.ignore_base_, false });
+
+        while( !work.empty() ) {
+            if( p_shutdown != nullptr && *p_shutdown )
+                return;
+
+            auto item = std::move(work.back());
+            work.pop_back();
+
+            // stamp taken before listing, concurrent changes then make it stale
+            auto stamp = directory_stamp(item.path);
+
+            // vanished after parent was listed
+            if( stamp == 0 && item.level != 0 )
+                continue;
+
+            uint64_t stored = 0;
+
+            st_sel_stamp.bind("id", item.id);
+
+            auto i = st_sel_stamp.begin();
+
+            if( i )
+                stored = i->get<uint64_t>(0);
+
+            st_sel_stamp.reset();
+
+            if( stamp != 0 && stamp == stored ) {
+                st_upd_touch_children.bind("parent_id", item.id);
+                st_upd_touch_children.execute();
+                batched();
+
+                auto ignore = item.ignore;
+
+                if( !dr.ignore_file_.empty() )
+                    ignore = dr.load_ignore(item.path, ignore);
+
+                st_sel_dirs.bind("parent_id", item.id);
+
+                for( auto d = st_sel_dirs.begin(); d != st_sel_dirs.end(); ++d ) {
+                    auto path = item.path + path_delimiter + utf2str(d->get<std::string>(1));
+                    auto id = d->get<uint64_t>(0);
+
+                    parents.emplace(std::make_pair(str2utf(path), id));
+                    work.push_back({ path, id, item.level + 1, ignore, false });
+                }
+
+                continue;
+            }
+
+            dr.base_level_ = item.level;
+            dr.ignore_base_ = item.ignore;
+            dr.read(item.path);
+            flush_pending();
+
+            if( dr.abort_ )
+                return;
+
+            store_stamp(item.id, stamp);
+        }
+    };
+
+    // lists only dirty directories and directories that appeared in them
+    auto reindex_dirty = [&] {
+        dr.spawner_ = spawner;
+
+        auto root_id = root_entry();
+        std::unordered_set<uint64_t> queued;
+
+        for( const auto & dirty : *p_dirty ) {
+            if( dirty.compare(0, root.size(), root) != 0
+                || (dirty.size() > root.size() && dirty[root.size()] != path_delimiter[0]) )
+                continue;
+
+            work_item item = { root, root_id, 0, dr.ignore_base_, false };
+
+            // deepest indexed and still existing ancestor, its listing finds
+            // the rest of path if it is new
+            for( size_t b = root.size() + 1; b < dirty.size(); ) {
+                auto e = dirty.find(path_delimiter[0], b);
+
+                if( e == string::npos )
+                    e = dirty.size();
+
+                auto utf_name = str2utf(dirty.substr(b, e - b));
+                auto path = dirty.substr(0, e);
+                b = e + 1;
+
+                st_sel.bind("parent_id", item.id);
+                st_sel.bind("name", utf_name, sqlite3pp::nocopy);
+
+                uint64_t id = 0;
+                auto i = st_sel.begin();
+
+                if( i )
+                    id = i->get<uint64_t>("rowid");
+
+                st_sel.reset();
+
+                if( id == 0 || directory_stamp(path) == 0 )
+                    break;
+
+                if( !dr.ignore_file_.empty() )
+                    item.ignore = dr.load_ignore(item.path, item.ignore);
+
+                item = { path, id, item.level + 1, item.ignore, false };
+            }
+
+            if( queued.insert(item.id).second )
+                work.push_back(std::move(item));
+        }
+
+        while( !work.empty() ) {
+            if( p_shutdown != nullptr && *p_shutdown )
+                return;
+
+            auto item = std::move(work.back());
+            work.pop_back();
+
+            auto stamp = directory_stamp(item.path);
+
+            if( stamp == 0 && item.level != 0 )
+                continue;
+
+            known.clear();
+            spawn_all = item.fresh;
+
+            if( !item.fresh ) {
+                st_sel_dirs.bind("parent_id", item.id);
+
+                for( auto d = st_sel_dirs.begin(); d != st_sel_dirs.end(); ++d )
+                    known.insert(d->get<uint64_t>(0));
+            }
+
+            st_upd_mark_children.bind("parent_id", item.id);
+            st_upd_mark_children.execute();
+
+            parents.emplace(std::make_pair(str2utf(item.path), item.id));
+
+            dr.base_level_ = item.level;
+            dr.ignore_base_ = item.ignore;
+            dr.read(item.path);
+            flush_pending();
+            verify_deferred(item.id);
+            // children digested after revival would stay touched
+            drain_pool();
+
+            if( dr.abort_ || (p_shutdown != nullptr && *p_shutdown) )
+                return;
+
+            st_chg_stale.bind("parent_id", item.id);
+            st_chg_stale.bind("kind", int(entry_change::deleted));
+            st_chg_stale.execute();
+            st_del_stale_blocks.bind("parent_id", item.id);
+            st_del_stale_blocks.execute();
+            st_del_stale.bind("parent_id", item.id);
+            st_del_stale.execute();
+            st_upd_revive_children.bind("parent_id", item.id);
+            st_upd_revive_children.execute();
+
+            store_stamp(item.id, stamp);
+        }
+    };
+
+    // traversal thread of full mode, the rest of modes look up database
+    // while traversing
+    auto reindex_pipelined = [&] {
+        dr.manipulator_ = [&] {
+            if( aborted || (p_shutdown != nullptr && *p_shutdown) ) {
+                dr.abort_ = true;
+                return;
+            }
+
+            if( !dr.accessible(R_OK | (dr.is_dir ? X_OK : 0)) )
+                return;
+
+            auto e = scan_entry();
+            backoff idle;
+
+            while( !q_entries.try_push(e) ) {
+                if( aborted || (p_shutdown != nullptr && *p_shutdown) ) {
+                    dr.abort_ = true;
+                    return;
+                }
+
+                idle();
+            }
+        };
+
+        std::thread emitter([&] {
+            try {
+                dr.read(dir_path_name);
+            }
+            catch( ... ) {
+                fail();
+            }
+
+            entries_done = true;
+        });
+
+        // traversal is stopped unless it is complete, at shutdown it stops
+        // by itself and hashers still send checkpoints
+        at_scope_exit(
+            if( !entries_done && (p_shutdown == nullptr || !*p_shutdown) )
+                aborted = true;
+
+            emitter.join();
+        );
+
+        backoff idle;
+        scan_item e;
+
+        for(;;) {
+            check_error();
+
+            if( p_shutdown != nullptr && *p_shutdown )
+                return;
+
+            bool done = entries_done;
+
+            if( q_entries.try_pop(e) ) {
+                process_entry(e);
+                idle.reset();
+            }
+            else if( drain_results() )
+                idle.reset();
+            else if( done )
+                break;
+            else
+                idle();
+        }
+
+        flush_pending();
+    };
+
+    if( p_dirty != nullptr ) {
+        reindex_dirty();
+        finish();
+        return;
+    }
+
+    if( incremental_ )
+        reindex_incremental();
+    else if( pipelined )
+        reindex_pipelined();
+    else {
+        dr.read(dir_path_name);
+        flush_pending();
+    }
+
+    verify_deferred(0);
+    finish();
+
+    // entries not reached yet must not be deleted
+    if( p_shutdown != nullptr && *p_shutdown )
+        return;
+
     auto cleanup_entries = [&db] {
         //sqlite3pp::query st_sel(db, R"EOS(
         //    SELECT
@@ -996,6 +3343,9 @@ void directory_indexer::reindex(
         //}
 
         db.execute_all(R"EOS(
+            INSERT INTO changes (entry_id, parent_id, name, kind)
+                SELECT rowid, parent_id, name, 4 /* entry_change::deleted */
+                FROM entries WHERE is_alive <> 0;
             DELETE FROM blocks_digests WHERE entry_id IN (
                 SELECT
                     rowid
@@ -0,0 +1,531 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+#include <algorithm>
+#include <type_traits>
+//------------------------------------------------------------------------------
+#include "indexer.hpp"
+#include "matcher.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+// DFA is rebuilt from scratch when it grows over this number of states
+constexpr const size_t max_dfa_states = 4096;
+//------------------------------------------------------------------------------
+bool name_matcher::char_class::match(string::value_type c) const
+{
+    for( const auto & r : ranges )
+        if( c >= r.first && c <= r.second )
+            return !negate;
+
+    return negate;
+}
+//------------------------------------------------------------------------------
+size_t name_matcher::state_set_hash::operator () (const state_set & s) const
+{
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+
+    for( auto w : s ) {
+        h ^= w;
+        h *= UINT64_C(0x100000001b3);
+    }
+
+    return size_t(h ^ (h >> 32));
+}
+//------------------------------------------------------------------------------
+void name_matcher::add_glob(const string & pattern)
+{
+    size_t start = nfa_.size();
+    auto i = pattern.cbegin(), e = pattern.cend();
+
+    while( i != e ) {
+        auto c = *i++;
+
+        if( c == CPPX_U('*') ) {
+            if( nfa_.size() == start || nfa_.back().type != tok_star )
+                nfa_.push_back({ tok_star, 0, 0 });
+        }
+        else if( c == CPPX_U('?') ) {
+            nfa_.push_back({ tok_any, 0, 0 });
+        }
+        else if( c == CPPX_U('[') ) {
+            char_class cls;
+            auto j = i;
+
+            cls.negate = j != e && (*j == CPPX_U('!') || *j == CPPX_U('^'));
+
+            if( cls.negate )
+                ++j;
+
+            // ']' right after '[' or '[!' is literal
+            bool first = true;
+
+            while( j != e && (first || *j != CPPX_U(']')) ) {
+                auto lo = *j++, hi = lo;
+
+                if( j + 1 < e && *j == CPPX_U('-') && *(j + 1) != CPPX_U(']') ) {
+                    hi = *(j + 1);
+                    j += 2;
+                }
+
+                cls.ranges.push_back(std::make_pair(lo, hi));
+                first = false;
+            }
+
+            if( j == e ) {
+                // unterminated class, '[' is literal
+                nfa_.push_back({ tok_char, c, 0 });
+                continue;
+            }
+
+            i = j + 1;
+            nfa_.push_back({ tok_class, 0, uint32_t(classes_.size()) });
+            classes_.emplace_back(std::move(cls));
+        }
+        else {
+            nfa_.push_back({ tok_char, c, 0 });
+        }
+    }
+
+    nfa_.push_back({ tok_accept, 0, 0 });
+
+    start_.resize((nfa_.size() + 63) / 64, 0);
+    start_[start / 64] |= UINT64_C(1) << (start % 64);
+}
+//------------------------------------------------------------------------------
+void name_matcher::closure(state_set & s) const
+{
+    // star may be skipped, positions only grow so one pass is enough
+    for( size_t p = 0; p < nfa_.size(); p++ )
+        if( (s[p / 64] & (UINT64_C(1) << (p % 64))) != 0 && nfa_[p].type == tok_star )
+            s[(p + 1) / 64] |= UINT64_C(1) << ((p + 1) % 64);
+}
+//------------------------------------------------------------------------------
+name_matcher::state_set name_matcher::step(const state_set & s, string::value_type c) const
+{
+    state_set r(s.size(), 0);
+
+    auto set = [&] (size_t p) {
+        r[p / 64] |= UINT64_C(1) << (p % 64);
+    };
+
+    for( size_t w = 0; w < s.size(); w++ ) {
+        for( uint64_t bits = s[w]; bits != 0; bits &= bits - 1 ) {
+            size_t b = 0;
+
+            while( (bits & (UINT64_C(1) << b)) == 0 )
+                b++;
+
+            size_t p = w * 64 + b;
+            const auto & t = nfa_[p];
+
+            switch( t.type ) {
+                case tok_star   :
+                    set(p);
+                    break;
+                case tok_char   :
+                    if( t.c == c )
+                        set(p + 1);
+                    break;
+                case tok_any    :
+                    set(p + 1);
+                    break;
+                case tok_class  :
+                    if( classes_[t.cls].match(c) )
+                        set(p + 1);
+                    break;
+                case tok_accept :
+                    break;
+            }
+        }
+    }
+
+    closure(r);
+
+    return r;
+}
+//------------------------------------------------------------------------------
+bool name_matcher::accepting(const state_set & s) const
+{
+    for( size_t p = 0; p < nfa_.size(); p++ )
+        if( (s[p / 64] & (UINT64_C(1) << (p % 64))) != 0 && nfa_[p].type == tok_accept )
+            return true;
+
+    return false;
+}
+//------------------------------------------------------------------------------
+int32_t name_matcher::state(state_set && s)
+{
+    auto i = states_index_.find(s);
+
+    if( i != states_index_.cend() )
+        return i->second;
+
+    if( states_.size() >= max_dfa_states )
+        flush_ = true;
+
+    std::unique_ptr<dfa_state> st(new dfa_state);
+
+    st->accept = accepting(s);
+    st->dead = std::all_of(s.cbegin(), s.cend(), [] (auto w) { return w == 0; });
+    st->next.fill(-1);
+    st->set = std::move(s);
+
+    auto id = int32_t(states_.size());
+    states_index_.emplace(std::make_pair(st->set, id));
+    states_.emplace_back(std::move(st));
+
+    return id;
+}
+//------------------------------------------------------------------------------
+bool name_matcher::match_dfa(const string & name)
+{
+    if( flush_ ) {
+        states_.clear();
+        states_index_.clear();
+        flush_ = false;
+    }
+
+    if( states_.empty() ) {
+        state_set s(start_);
+        closure(s);
+        state(std::move(s));
+    }
+
+    typedef typename std::make_unsigned<string::value_type>::type uchar_type;
+
+    int32_t id = 0;
+
+    for( auto c : name ) {
+        auto & st = *states_[id];
+
+        if( st.dead )
+            return false;
+
+        auto uc = uchar_type(c);
+#if _WIN32
+        // transitions are cached for 8-bit code units only
+        const bool cached = uc < 256;
+#else
+        constexpr bool cached = true;
+#endif
+        int32_t next = cached ? st.next[uc] : -1;
+
+        if( next < 0 ) {
+            next = state(step(st.set, c));
+
+            if( cached )
+                st.next[uc] = next;
+        }
+
+        id = next;
+    }
+
+    return states_[id]->accept;
+}
+//------------------------------------------------------------------------------
+void name_matcher::compile(const string & patterns, bool is_regex)
+{
+    nfa_.clear();
+    classes_.clear();
+    states_.clear();
+    states_index_.clear();
+    start_.clear();
+    literals_.clear();
+    suffixes_.clear();
+    suffixes_sizes_.clear();
+    regex_ = nullptr;
+    any_ = false;
+    empty_ = patterns.empty();
+
+    if( is_regex ) {
+        if( !empty_ )
+            regex_.reset(new regex(patterns));
+        return;
+    }
+
+    auto is_wild = [] (auto c) {
+        return c == CPPX_U('*') || c == CPPX_U('?') || c == CPPX_U('[');
+    };
+
+    size_t b = 0;
+
+    while( b <= patterns.size() ) {
+        auto e = patterns.find(CPPX_U(';'), b);
+
+        if( e == string::npos )
+            e = patterns.size();
+
+        string p(patterns, b, e - b);
+        b = e + 1;
+
+        if( p.empty() )
+            continue;
+
+        if( p.find_first_not_of(CPPX_U('*')) == string::npos ) {
+            any_ = true;
+        }
+        else if( std::none_of(p.cbegin(), p.cend(), is_wild) ) {
+            literals_.insert(p);
+        }
+        else if( p.front() == CPPX_U('*') && std::none_of(p.cbegin() + 1, p.cend(), is_wild) ) {
+            auto s = p.substr(1);
+
+            if( std::find(suffixes_sizes_.cbegin(), suffixes_sizes_.cend(), s.size()) == suffixes_sizes_.cend() )
+                suffixes_sizes_.push_back(s.size());
+
+            suffixes_.insert(std::move(s));
+        }
+        else {
+            add_glob(p);
+        }
+    }
+}
+//------------------------------------------------------------------------------
+bool name_matcher::match(const string & name)
+{
+    if( regex_ != nullptr )
+        return std::regex_match(name, *regex_);
+
+    if( any_ )
+        return true;
+
+    if( !literals_.empty() && literals_.find(name) != literals_.cend() )
+        return true;
+
+    for( auto l : suffixes_sizes_ ) {
+        if( name.size() < l )
+            continue;
+
+        tail_.assign(name, name.size() - l, l);
+
+        if( suffixes_.find(tail_) != suffixes_.cend() )
+            return true;
+    }
+
+    if( !nfa_.empty() )
+        return match_dfa(name);
+
+    return false;
+}
+//------------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+//------------------------------------------------------------------------------
+static bool is_path_delimiter(string::value_type c)
+{
+    return c == CPPX_U('/') || c == path_delimiter[0];
+}
+//------------------------------------------------------------------------------
+// glob over path, '*' and '?' don't match delimiter, '**' does
+static bool path_glob_match(
+    string::const_iterator p, string::const_iterator pe,
+    string::const_iterator t, string::const_iterator te)
+{
+    while( p != pe ) {
+        auto c = *p;
+
+        if( c == CPPX_U('*') ) {
+            auto q = p;
+
+            while( q != pe && *q == CPPX_U('*') )
+                ++q;
+
+            if( q - p > 1 ) {
+                // '**/' matches zero or more directories
+                if( q != pe && is_path_delimiter(*q) ) {
+                    ++q;
+
+                    for( auto u = t;; ) {
+                        if( path_glob_match(q, pe, u, te) )
+                            return true;
+
+                        u = std::find_if(u, te, is_path_delimiter);
+
+                        if( u == te )
+                            return false;
+
+                        ++u;
+                    }
+                }
+
+                for( auto u = t;; ++u ) {
+                    if( path_glob_match(q, pe, u, te) )
+                        return true;
+                    if( u == te )
+                        return false;
+                }
+            }
+
+            for( auto u = t;; ++u ) {
+                if( path_glob_match(q, pe, u, te) )
+                    return true;
+                if( u == te || is_path_delimiter(*u) )
+                    return false;
+            }
+        }
+
+        if( t == te )
+            return false;
+
+        if( c == CPPX_U('?') ) {
+            if( is_path_delimiter(*t) )
+                return false;
+        }
+        else if( c == CPPX_U('[') && std::find(p + 1, pe, CPPX_U(']')) != pe ) {
+            auto j = p + 1;
+            bool negate = *j == CPPX_U('!') || *j == CPPX_U('^'), match = false, first = true;
+
+            if( negate )
+                ++j;
+
+            while( j != pe && (first || *j != CPPX_U(']')) ) {
+                auto lo = *j++, hi = lo;
+
+                if( j + 1 < pe && *j == CPPX_U('-') && *(j + 1) != CPPX_U(']') ) {
+                    hi = *(j + 1);
+                    j += 2;
+                }
+
+                match = match || (*t >= lo && *t <= hi);
+                first = false;
+            }
+
+            if( j == pe )
+                return false;
+
+            if( match == negate || is_path_delimiter(*t) )
+                return false;
+
+            p = j;
+        }
+        else if( c == CPPX_U('\\') && p + 1 != pe && !is_path_delimiter(CPPX_U('\\')) ) {
+            if( *++p != *t )
+                return false;
+        }
+        else if( is_path_delimiter(c) ? !is_path_delimiter(*t) : c != *t ) {
+            return false;
+        }
+
+        ++p;
+        ++t;
+    }
+
+    return t == te;
+}
+//------------------------------------------------------------------------------
+std::shared_ptr<const ignore_list> ignore_list::parse(
+    const std::shared_ptr<const ignore_list> & parent,
+    const string & dir_path,
+    const std::string & utf_content)
+{
+    std::shared_ptr<ignore_list> list = std::make_shared<ignore_list>();
+    string content = utf2str(utf_content);
+    size_t b = 0;
+
+    while( b < content.size() ) {
+        auto e = content.find(CPPX_U('\n'), b);
+
+        if( e == string::npos )
+            e = content.size();
+
+        string line(content, b, e - b);
+        b = e + 1;
+
+        if( !line.empty() && line.back() == CPPX_U('\r') )
+            line.pop_back();
+
+        // trailing spaces are ignored unless escaped
+        while( !line.empty() && line.back() == CPPX_U(' ')
+            && !(line.size() > 1 && line[line.size() - 2] == CPPX_U('\\')) )
+            line.pop_back();
+
+        if( line.empty() || line.front() == CPPX_U('#') )
+            continue;
+
+        rule r;
+        r.negate = line.front() == CPPX_U('!');
+
+        if( r.negate )
+            line.erase(0, 1);
+        else if( line.size() > 1 && line.front() == CPPX_U('\\')
+            && (line[1] == CPPX_U('!') || line[1] == CPPX_U('#')) )
+            line.erase(0, 1);
+
+        r.dir_only = !line.empty() && line.back() == CPPX_U('/');
+
+        if( r.dir_only )
+            line.pop_back();
+
+        r.name_only = line.find(CPPX_U('/')) == string::npos;
+
+        if( !r.name_only && line.front() == CPPX_U('/') )
+            line.erase(0, 1);
+
+        if( line.empty() )
+            continue;
+
+        r.pattern = std::move(line);
+        list->rules_.emplace_back(std::move(r));
+    }
+
+    if( list->rules_.empty() )
+        return parent;
+
+    list->parent_ = parent;
+    list->base_ = dir_path;
+
+    if( list->base_.empty() || list->base_.back() != path_delimiter[0] )
+        list->base_ += path_delimiter;
+
+    return list;
+}
+//------------------------------------------------------------------------------
+bool ignore_list::ignored(const string & path_name, const string & name, bool is_dir) const
+{
+    for( auto list = this; list != nullptr; list = list->parent_.get() ) {
+        bool rel = path_name.size() > list->base_.size()
+            && path_name.compare(0, list->base_.size(), list->base_) == 0;
+
+        for( auto r = list->rules_.crbegin(); r != list->rules_.crend(); ++r ) {
+            if( r->dir_only && !is_dir )
+                continue;
+
+            bool match;
+
+            if( r->name_only )
+                match = path_glob_match(r->pattern.cbegin(), r->pattern.cend(), name.cbegin(), name.cend());
+            else
+                match = rel && path_glob_match(r->pattern.cbegin(), r->pattern.cend(),
+                    path_name.cbegin() + list->base_.size(), path_name.cend());
+
+            if( match )
+                return !r->negate;
+        }
+    }
+
+    return false;
+}
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
@@ -0,0 +1,175 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include "config.h"
+//------------------------------------------------------------------------------
+#include <fstream>
+#include <sstream>
+#include <vector>
+#if __linux__
+#include <sys/sysmacros.h>
+#endif
+//------------------------------------------------------------------------------
+#include "mounts.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+mount_table::mount_table()
+{
+    static const char * const skipped[] = {
+        // pseudo filesystems, tmpfs and ramfs hold real files and are indexed
+        "proc", "sysfs", "devtmpfs", "devpts", "cgroup", "cgroup2",
+        "securityfs", "debugfs", "tracefs", "pstore", "bpf", "configfs", "fusectl",
+        "mqueue", "hugetlbfs", "autofs", "binfmt_misc", "efivarfs", "selinuxfs",
+        "rpc_pipefs", "nsfs", "overlay_proc",
+        // network filesystems
+        "nfs", "nfs4", "cifs", "smb3", "smbfs", "ncpfs", "afs", "ceph", "glusterfs",
+        "fuse.glusterfs", "fuse.sshfs", "fuse.rclone", "davfs", "9p"
+    };
+
+    for( auto t : skipped )
+        skip_types_.emplace(utf2str(t));
+}
+//------------------------------------------------------------------------------
+void mount_table::apply(mount_point & mp) const
+{
+    auto i = path_policies_.find(mp.path);
+
+    if( i != path_policies_.cend() )
+        mp.skip = i->second;
+    else
+        mp.skip = skip_types_.find(mp.type) != skip_types_.cend();
+}
+//------------------------------------------------------------------------------
+mount_table & mount_table::skip_type(const string & type, bool skip)
+{
+    if( skip )
+        skip_types_.emplace(type);
+    else
+        skip_types_.erase(type);
+
+    for( auto & m : mounts_ )
+        apply(m.second);
+
+    return *this;
+}
+//------------------------------------------------------------------------------
+mount_table & mount_table::skip_path(const string & path, bool skip)
+{
+    path_policies_[path] = skip;
+
+    auto i = mounts_.find(path);
+
+    if( i != mounts_.end() )
+        apply(i->second);
+
+    return *this;
+}
+//------------------------------------------------------------------------------
+// fields of mountinfo are space separated, spaces, tabs, newlines and back
+// slashes inside of them are escaped as octal \ooo
+static std::string unescape_mountinfo(const std::string & s)
+{
+    std::string r;
+
+    for( size_t i = 0; i < s.size(); i++ ) {
+        if( s[i] == '\\' && i + 3 < s.size()
+            && s[i + 1] >= '0' && s[i + 1] <= '3'
+            && s[i + 2] >= '0' && s[i + 2] <= '7'
+            && s[i + 3] >= '0' && s[i + 3] <= '7' ) {
+            r.push_back(char(((s[i + 1] - '0') << 6) | ((s[i + 2] - '0') << 3) | (s[i + 3] - '0')));
+            i += 3;
+        }
+        else
+            r.push_back(s[i]);
+    }
+
+    return r;
+}
+//------------------------------------------------------------------------------
+void mount_table::parse_mountinfo(const std::string & content)
+{
+    // 36 35 98:0 /mnt1 /mnt/parent rw,noatime master:1 - ext3 /dev/root rw,errors=continue
+    std::istringstream in(content);
+    std::string line;
+    std::vector<std::string> fields;
+
+    while( std::getline(in, line) ) {
+        std::istringstream ls(line);
+        std::string f;
+
+        fields.clear();
+
+        while( ls >> f )
+            fields.push_back(f);
+
+        size_t sep = 6;
+
+        while( sep < fields.size() && fields[sep] != "-" )
+            sep++;
+
+        if( fields.size() < 5 || sep + 2 >= fields.size() )
+            continue;
+
+        mount_point mp;
+        mp.path = utf2str(unescape_mountinfo(fields[4]));
+        mp.type = utf2str(fields[sep + 1]);
+        mp.source = utf2str(unescape_mountinfo(fields[sep + 2]));
+
+        auto colon = fields[2].find(':');
+
+        if( colon != std::string::npos ) {
+            auto major = std::stoul(fields[2].substr(0, colon));
+            auto minor = std::stoul(fields[2].substr(colon + 1));
+#if __linux__
+            mp.dev = makedev(major, minor);
+#else
+            mp.dev = (uint64_t(major) << 32) | minor;
+#endif
+        }
+
+        apply(mp);
+
+        // later mounts over the same path hide earlier ones
+        mounts_[mp.path] = std::move(mp);
+    }
+}
+//------------------------------------------------------------------------------
+std::shared_ptr<mount_table> mount_table::load()
+{
+    std::shared_ptr<mount_table> table(new mount_table);
+#if __linux__
+    std::ifstream in("/proc/self/mountinfo", std::ios::binary);
+
+    if( in ) {
+        std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        table->parse_mountinfo(content);
+    }
+#endif
+    return table;
+}
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
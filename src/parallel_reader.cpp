@@ -0,0 +1,188 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <exception>
+//------------------------------------------------------------------------------
+#include "scope_exit.hpp"
+#include "bounded_queue.hpp"
+#include "parallel_reader.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+void parallel_directory_reader::read(const string & root_path)
+{
+    struct work_item {
+        string path;
+        uintptr_t level;
+        std::shared_ptr<const ignore_list> ignore;
+    };
+
+    struct work_queue {
+        std::mutex mtx;
+        std::deque<work_item> items;
+    };
+
+    uintptr_t n = threads_ != 0 ? threads_ : std::thread::hardware_concurrency();
+
+    if( n == 0 )
+        n = 1;
+
+    std::vector<std::unique_ptr<work_queue>> queues;
+
+    for( uintptr_t i = 0; i < n; i++ )
+        queues.emplace_back(new work_queue);
+
+    // directories queued or being read at the moment, when it drops to zero
+    // the whole tree is done because subdirectories are queued before
+    // their parent is accounted as finished
+    std::atomic<uintptr_t> pending(1);
+
+    std::mutex error_mtx;
+    std::exception_ptr error;
+
+    // mount table and device to stay on are the same for all threads
+    directory_reader root_reader(prototype_);
+    root_reader.prepare(root_path);
+
+    queues[0]->items.push_back({ root_path, 0, prototype_.ignore_base_ });
+    abort_ = false;
+
+    auto pop = [&] (uintptr_t id, work_item & item) {
+        {
+            auto & q = *queues[id];
+            std::unique_lock<std::mutex> lk(q.mtx);
+
+            if( !q.items.empty() ) {
+                item = std::move(q.items.back());
+                q.items.pop_back();
+                return true;
+            }
+        }
+
+        for( uintptr_t i = 1; i < n; i++ ) {
+            auto & q = *queues[(id + i) % n];
+            std::unique_lock<std::mutex> lk(q.mtx);
+
+            if( !q.items.empty() ) {
+                item = std::move(q.items.front());
+                q.items.pop_front();
+                return true;
+            }
+        }
+
+        return false;
+    };
+
+    auto worker = [&] (uintptr_t id) {
+        directory_reader dr = prototype_;
+
+        dr.recursive_ = true;
+        dr.mounts_ = root_reader.mounts_;
+        dr.root_dev_ = root_reader.boundary_dev_;
+#if HAVE_IO_URING && HAVE_STATX
+        dr.uring_ = nullptr;
+#endif
+        dr.manipulator_ = [&] {
+            if( abort_ ) {
+                dr.abort_ = true;
+                return;
+            }
+
+            manipulator_(dr);
+        };
+        dr.spawner_ = [&] {
+            if( abort_ ) {
+                dr.abort_ = true;
+                return;
+            }
+
+            auto & q = *queues[id];
+            std::unique_lock<std::mutex> lk(q.mtx);
+
+            pending.fetch_add(1);
+            q.items.push_back({ dr.path_name_, dr.level_, dr.ignore_ });
+        };
+
+        backoff idle;
+        work_item item;
+
+        for(;;) {
+            if( pop(id, item) ) {
+                idle.reset();
+                dr.base_level_ = item.level;
+                dr.ignore_base_ = item.ignore;
+
+                try {
+                    if( !abort_ )
+                        dr.read(item.path);
+                }
+                catch( ... ) {
+                    std::unique_lock<std::mutex> lk(error_mtx);
+
+                    if( error == nullptr )
+                        error = std::current_exception();
+
+                    abort_ = true;
+                }
+
+                pending.fetch_sub(1);
+                continue;
+            }
+
+            if( pending == 0 )
+                break;
+
+            idle();
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    at_scope_exit(
+        for( auto & t : threads )
+            t.join();
+    );
+
+    for( uintptr_t i = 1; i < n; i++ )
+        threads.emplace_back(worker, i);
+
+    worker(0);
+
+    for( auto & t : threads )
+        t.join();
+
+    threads.clear();
+
+    if( error != nullptr )
+        std::rethrow_exception(error);
+}
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
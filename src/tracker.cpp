@@ -23,6 +23,7 @@
  */
 //------------------------------------------------------------------------------
 #include "cdc512.hpp"
+#include "watcher.hpp"
 #include "tracker.hpp"
 //------------------------------------------------------------------------------
 namespace spacenet {
@@ -35,6 +36,15 @@ void directory_tracker::worker()
     directory_indexer di;
 
     di.modified_only(true);
+    di.threads(std::thread::hardware_concurrency());
+#if HAVE_IO_URING
+    di.uring_depth(32);
+#endif
+
+    // in incremental mode every full_period pass is full to catch in place
+    // modified files in directories whose stamp has not changed
+    constexpr uintptr_t full_period = 60;
+    uintptr_t pass = 0;
 
     auto connect_db = [&] {
         if( db.connected() )
@@ -63,16 +73,100 @@ void directory_tracker::worker()
         db.exceptions(true);
     };
 
+#if HAVE_INOTIFY
+    // with watcher rescans are only a safety net for lost events
+    constexpr auto watch_rescan_period = 1h;
+
+    std::unique_ptr<directory_watcher> watcher;
+    std::unordered_set<string> dirty;
+    bool watch_failed = false;
+    auto rescan_deadline = std::chrono::steady_clock::now();
+#endif
+
     for(;;) {
+        bool rescan = true, failed = false;
+
         try {
             connect_db();
-            di.reindex(db, dir_path_name_, &shutdown_);
+#if HAVE_INOTIFY
+            // watches are set before rescan, so changes made during it are not lost
+            if( watch_ && watcher == nullptr && !watch_failed ) {
+                try {
+                    watcher.reset(new directory_watcher(dir_path_name_));
+                }
+                catch( std::exception & e ) {
+                    error_ = utf2str(e.what());
+                    watch_failed = true;
+                }
+            }
+
+            if( watcher != nullptr && pass != 0 && !watcher->overflow()
+                && std::chrono::steady_clock::now() < rescan_deadline ) {
+                rescan = false;
+                bool quiet = false;
+
+                try {
+                    quiet = !watcher->wait(500, dirty);
+                }
+                catch( std::exception & e ) {
+                    // watcher can't cover whole tree, fall back to polling
+                    error_ = utf2str(e.what());
+                    watcher = nullptr;
+                    watch_failed = true;
+                    // events may be lost, next rescan is full
+                    rescan = true;
+                    pass = 0;
+                }
+
+                // events are coalesced until tree is quiet for one poll period
+                if( quiet && !dirty.empty() ) {
+                    std::vector<string> paths(dirty.cbegin(), dirty.cend());
+                    dirty.clear();
+
+                    // failed directories are reindexed with the next ones
+                    try {
+                        di.reindex(db, dir_path_name_, &shutdown_, &paths);
+                    }
+                    catch( ... ) {
+                        dirty.insert(paths.cbegin(), paths.cend());
+                        throw;
+                    }
+                }
+            }
+            else
+                dirty.clear();
+#endif
+            if( rescan ) {
+                bool full = !incremental_ || pass % full_period == 0;
+#if HAVE_INOTIFY
+                // watcher mode rescan is rare safety net for lost events,
+                // in place modifications included
+                full = full || watcher != nullptr;
+#endif
+                di.incremental(!full);
+                pass++;
+                di.reindex(db, dir_path_name_, &shutdown_);
+            }
         }
         catch( std::exception & e ) {
             error_ = utf2str(e.what());
             db.disconnect();
+            failed = true;
         }
 
+#if HAVE_INOTIFY
+        // after failure watcher waits as poller does, then failed rescan is
+        // repeated
+        if( watcher != nullptr && !failed ) {
+            if( rescan )
+                rescan_deadline = std::chrono::steady_clock::now() + watch_rescan_period;
+
+            if( shutdown_ )
+                break;
+
+            continue;
+        }
+#endif
         std::unique_lock<std::mutex> lk(mtx_);
 
         auto now = std::chrono::system_clock::now();
@@ -107,7 +201,7 @@ void directory_tracker::run()
 
         cdc512 ctx(s.cbegin(), s.cend());
 
-        if( strlen(t.c_str()) > 13 )
+        if( t.size() > 13 )
             t = t.substr(0, 13);
 
         t.push_back(CPPX_U('-'));
@@ -0,0 +1,180 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+#include "config.h"
+//------------------------------------------------------------------------------
+#if HAVE_IO_URING
+//------------------------------------------------------------------------------
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+//------------------------------------------------------------------------------
+#include "uring.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+void io_uring_queue::close()
+{
+    if( sqes_ != nullptr )
+        ::munmap(sqes_, sqes_size_);
+
+    if( cq_ptr_ != nullptr && cq_ptr_ != sq_ptr_ )
+        ::munmap(cq_ptr_, cq_size_);
+
+    if( sq_ptr_ != nullptr )
+        ::munmap(sq_ptr_, sq_size_);
+
+    if( fd_ != -1 )
+        ::close(fd_);
+
+    sqes_ = nullptr;
+    cq_ptr_ = sq_ptr_ = nullptr;
+    fd_ = -1;
+}
+//------------------------------------------------------------------------------
+io_uring_queue::~io_uring_queue()
+{
+    close();
+}
+//------------------------------------------------------------------------------
+io_uring_queue::io_uring_queue(unsigned entries)
+{
+    io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+
+    fd_ = int(::syscall(__NR_io_uring_setup, entries, &p));
+
+    if( fd_ == -1 ) {
+        auto err = errno;
+        throw std::runtime_error("Failed to setup io_uring, " + std::to_string(err));
+    }
+
+    auto fail = [&] {
+        auto err = errno;
+        close();
+        throw std::runtime_error("Failed to map io_uring, " + std::to_string(err));
+    };
+
+    entries_ = p.sq_entries;
+    sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+
+    if( (p.features & IORING_FEAT_SINGLE_MMAP) != 0 && cq_size_ > sq_size_ )
+        sq_size_ = cq_size_;
+
+    sq_ptr_ = ::mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+
+    if( sq_ptr_ == MAP_FAILED ) {
+        sq_ptr_ = nullptr;
+        fail();
+    }
+
+    if( (p.features & IORING_FEAT_SINGLE_MMAP) != 0 ) {
+        cq_ptr_ = sq_ptr_;
+    }
+    else {
+        cq_ptr_ = ::mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+
+        if( cq_ptr_ == MAP_FAILED ) {
+            cq_ptr_ = nullptr;
+            fail();
+        }
+    }
+
+    sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = (io_uring_sqe *) ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+
+    if( sqes_ == MAP_FAILED ) {
+        sqes_ = nullptr;
+        fail();
+    }
+
+    auto sq = (uint8_t *) sq_ptr_;
+    auto cq = (uint8_t *) cq_ptr_;
+
+    sq_head_ = (unsigned *) (sq + p.sq_off.head);
+    sq_tail_ = (unsigned *) (sq + p.sq_off.tail);
+    sq_mask_ = (unsigned *) (sq + p.sq_off.ring_mask);
+    sq_array_ = (unsigned *) (sq + p.sq_off.array);
+    cq_head_ = (unsigned *) (cq + p.cq_off.head);
+    cq_tail_ = (unsigned *) (cq + p.cq_off.tail);
+    cq_mask_ = (unsigned *) (cq + p.cq_off.ring_mask);
+    cqes_ = (io_uring_cqe *) (cq + p.cq_off.cqes);
+
+    sq_local_tail_ = *sq_tail_;
+}
+//------------------------------------------------------------------------------
+io_uring_sqe * io_uring_queue::get_sqe()
+{
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+
+    if( sq_local_tail_ - head >= entries_ )
+        return nullptr;
+
+    unsigned i = sq_local_tail_ & *sq_mask_;
+    io_uring_sqe * sqe = &sqes_[i];
+
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array_[i] = i;
+    sq_local_tail_++;
+    to_submit_++;
+
+    return sqe;
+}
+//------------------------------------------------------------------------------
+int io_uring_queue::register_buffers(const iovec * iov, unsigned n)
+{
+    int r = int(::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS, iov, n));
+
+    return r == -1 ? -errno : 0;
+}
+//------------------------------------------------------------------------------
+int io_uring_queue::submit(unsigned wait_nr)
+{
+    __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+
+    int r;
+
+    do {
+        r = int(::syscall(__NR_io_uring_enter, fd_, to_submit_, wait_nr,
+            wait_nr != 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+    }
+    while( r == -1 && errno == EINTR );
+
+    if( r == -1 )
+        return -errno;
+
+    to_submit_ -= unsigned(r) < to_submit_ ? unsigned(r) : to_submit_;
+
+    return r;
+}
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
+#endif // HAVE_IO_URING
+//------------------------------------------------------------------------------
@@ -0,0 +1,340 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include "config.h"
+//------------------------------------------------------------------------------
+#if HAVE_INOTIFY
+//------------------------------------------------------------------------------
+#include <sys/inotify.h>
+#if HAVE_FANOTIFY
+#include <sys/fanotify.h>
+#endif
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstdio>
+#include <stdexcept>
+//------------------------------------------------------------------------------
+#include "watcher.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+static constexpr const uint32_t inotify_mask =
+    IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB
+    | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+//------------------------------------------------------------------------------
+#if HAVE_FANOTIFY && defined(FAN_REPORT_DFID_NAME)
+static constexpr const uint64_t fanotify_mask =
+    FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_MODIFY | FAN_CLOSE_WRITE | FAN_ATTRIB
+    | FAN_ONDIR;
+#endif
+//------------------------------------------------------------------------------
+// root directory keeps its delimiter, so paths under it don't get doubled one
+static string subpath(const string & path, const string & name)
+{
+    if( !path.empty() && path.back() == path_delimiter[0] )
+        return path + name;
+
+    return path + path_delimiter + name;
+}
+//------------------------------------------------------------------------------
+directory_watcher::directory_watcher(const string & root) : root_(root)
+{
+    if( root_.size() > 1 && root_.back() == path_delimiter[0] )
+        root_.pop_back();
+
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if( fd_ == -1 ) {
+        auto err = errno;
+        throw std::runtime_error("Failed to initialize inotify, " + std::to_string(err));
+    }
+
+    // destructor isn't called when constructor throws
+    try {
+        add_watches(root_);
+    }
+    catch( ... ) {
+        close();
+        throw;
+    }
+}
+//------------------------------------------------------------------------------
+void directory_watcher::close()
+{
+    if( fd_ != -1 ) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    if( mount_fd_ != -1 ) {
+        ::close(mount_fd_);
+        mount_fd_ = -1;
+    }
+
+    watches_.clear();
+}
+//------------------------------------------------------------------------------
+void directory_watcher::add_watches(const string & path)
+{
+    bool full = false;
+
+    auto add = [&] (const string & path_name) {
+        int wd = inotify_add_watch(fd_, path_name.c_str(), inotify_mask);
+
+        if( wd != -1 )
+            watches_[wd] = path_name;
+        else if( errno == ENOSPC )
+            full = true;
+        // else directory vanished or inaccessible, it isn't indexed anyway
+    };
+
+    add(path);
+
+    directory_reader dr;
+    dr.recursive_ = dr.list_directories_ = true;
+#if HAVE_STATX
+    dr.statx_mask_ = 0;
+#endif
+    dr.manipulator_ = [&] {
+        if( dr.is_dir )
+            add(dr.path_name_);
+
+        dr.abort_ = full;
+    };
+
+    if( !full ) {
+        try {
+            dr.read(path);
+        }
+        catch( const std::runtime_error & ) {
+            // directory vanished while reading, parent events cover it
+        }
+    }
+
+    if( full )
+        switch_to_fanotify();
+}
+//------------------------------------------------------------------------------
+void directory_watcher::remove_watches(const string & path)
+{
+    auto prefix = subpath(path, string());
+
+    for( auto i = watches_.begin(); i != watches_.end(); ) {
+        if( i->second == path || i->second.compare(0, prefix.size(), prefix) == 0 ) {
+            inotify_rm_watch(fd_, i->first);
+            i = watches_.erase(i);
+        }
+        else
+            i++;
+    }
+}
+//------------------------------------------------------------------------------
+void directory_watcher::switch_to_fanotify()
+{
+#if HAVE_FANOTIFY && defined(FAN_REPORT_DFID_NAME)
+    // inotify is closed only after fanotify is set up, so on failure watcher
+    // keeps its descriptors and destructor releases them
+    int fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_CLOEXEC);
+
+    if( fd == -1 ) {
+        auto err = errno;
+        throw std::runtime_error("Failed to initialize fanotify, " + std::to_string(err));
+    }
+
+    if( fanotify_mark(fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, fanotify_mask, AT_FDCWD, root_.c_str()) != 0 ) {
+        auto err = errno;
+        ::close(fd);
+        throw std::runtime_error("Failed to mark filesystem: " + root_ + ", " + std::to_string(err));
+    }
+
+    int mount_fd = ::open(root_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if( mount_fd == -1 ) {
+        auto err = errno;
+        ::close(fd);
+        throw std::runtime_error("Failed to open directory: " + root_ + ", " + std::to_string(err));
+    }
+
+    close();
+
+    fd_ = fd;
+    mount_fd_ = mount_fd;
+    fanotify_ = true;
+#else
+    throw std::runtime_error("inotify watches limit exceeded and fanotify isn't available");
+#endif
+}
+//------------------------------------------------------------------------------
+void directory_watcher::read_inotify(std::unordered_set<string> & dirty)
+{
+    alignas(inotify_event) char buf[65536];
+
+    for(;;) {
+        auto r = ::read(fd_, buf, sizeof(buf));
+
+        if( r < 0 && errno == EINTR )
+            continue;
+
+        if( r <= 0 )
+            break;
+
+        for( const char * p = buf; p < buf + r; ) {
+            auto ev = reinterpret_cast<const inotify_event *>(p);
+            p += sizeof(inotify_event) + ev->len;
+
+            if( (ev->mask & IN_Q_OVERFLOW) != 0 ) {
+                overflow_ = true;
+                continue;
+            }
+
+            auto i = watches_.find(ev->wd);
+
+            if( i == watches_.end() )
+                continue;
+
+            if( (ev->mask & IN_IGNORED) != 0 ) {
+                watches_.erase(i);
+                continue;
+            }
+
+            // copy, add_watches may rehash watches_
+            auto path = i->second;
+            dirty.insert(path);
+
+            if( (ev->mask & IN_ISDIR) == 0 || ev->len == 0 )
+                continue;
+
+            auto path_name = subpath(path, ev->name);
+
+            if( (ev->mask & IN_MOVED_FROM) != 0 )
+                remove_watches(path_name);
+            else if( (ev->mask & (IN_CREATE | IN_MOVED_TO)) != 0 ) {
+                add_watches(path_name);
+
+                // switched to fanotify, rest of buffer is useless
+                if( fanotify_ ) {
+                    overflow_ = true;
+                    return;
+                }
+            }
+        }
+    }
+}
+//------------------------------------------------------------------------------
+void directory_watcher::read_fanotify(std::unordered_set<string> & dirty)
+{
+#if HAVE_FANOTIFY && defined(FAN_REPORT_DFID_NAME)
+    alignas(fanotify_event_metadata) char buf[65536];
+    char link[64];
+    string path;
+
+    for(;;) {
+        auto r = ::read(fd_, buf, sizeof(buf));
+
+        if( r < 0 && errno == EINTR )
+            continue;
+
+        if( r <= 0 )
+            break;
+
+        auto meta = reinterpret_cast<const fanotify_event_metadata *>(buf);
+
+        for( ; FAN_EVENT_OK(meta, r); meta = FAN_EVENT_NEXT(meta, r) ) {
+            if( meta->vers != FANOTIFY_METADATA_VERSION )
+                throw std::runtime_error("Unsupported fanotify metadata version");
+
+            if( (meta->mask & FAN_Q_OVERFLOW) != 0 ) {
+                overflow_ = true;
+                continue;
+            }
+
+            auto info = reinterpret_cast<const fanotify_event_info_fid *>(
+                reinterpret_cast<const char *>(meta) + meta->metadata_len);
+
+            if( info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME
+                && info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID )
+                continue;
+
+            auto handle = reinterpret_cast<file_handle *>(const_cast<unsigned char *>(info->handle));
+            int dfd = open_by_handle_at(mount_fd_, handle, O_PATH | O_CLOEXEC);
+
+            // directory is gone, its parent gets own event
+            if( dfd == -1 )
+                continue;
+
+            at_scope_exit( ::close(dfd) );
+
+            snprintf(link, sizeof(link), "/proc/self/fd/%d", dfd);
+            path.resize(4096);
+
+            auto n = ::readlink(link, &path[0], path.size());
+
+            if( n <= 0 )
+                continue;
+
+            path.resize(n);
+
+            // filesystem mark reports the whole filesystem, root ends with
+            // delimiter if it is root directory
+            if( path.compare(0, root_.size(), root_) == 0
+                && (path.size() == root_.size()
+                    || root_.back() == path_delimiter[0]
+                    || path[root_.size()] == path_delimiter[0]) )
+                dirty.insert(path);
+        }
+    }
+#else
+    (void) dirty;
+#endif
+}
+//------------------------------------------------------------------------------
+bool directory_watcher::wait(int timeout, std::unordered_set<string> & dirty)
+{
+    pollfd pfd = { fd_, POLLIN, 0 };
+
+    int r = ::poll(&pfd, 1, timeout);
+
+    if( r < 0 && errno != EINTR ) {
+        auto err = errno;
+        throw std::runtime_error("Failed to poll watcher, " + std::to_string(err));
+    }
+
+    if( r <= 0 )
+        return false;
+
+    if( fanotify_ )
+        read_fanotify(dirty);
+    else
+        read_inotify(dirty);
+
+    return true;
+}
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
+#endif // HAVE_INOTIFY
+//------------------------------------------------------------------------------
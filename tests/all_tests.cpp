@@ -26,8 +26,15 @@
 //------------------------------------------------------------------------------
 #include "locale_traits.hpp"
 #include "cdc512.hpp"
+#include "chunker.hpp"
 #include "rand.hpp"
+#include "matcher.hpp"
+#include "mounts.hpp"
+#include "bounded_queue.hpp"
+#include "block_reader.hpp"
 #include "indexer.hpp"
+#include "parallel_reader.hpp"
+#include "watcher.hpp"
 #include "tracker.hpp"
 //------------------------------------------------------------------------------
 namespace spacenet {
@@ -38,7 +45,17 @@ void run_tests()
 {
     locale_traits_test();
     cdc512_test();
+    chunker_test();
+    matcher_test();
+    mounts_test();
+    bounded_queue_test();
+    block_reader_test();
     indexer_test();
+    parallel_reader_test();
+#if HAVE_INOTIFY
+    watcher_test();
+#endif
+    reader_bench();
     tracker_test();
     rand_test();
 }
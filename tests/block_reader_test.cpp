@@ -0,0 +1,195 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#if !_WIN32
+#include <unistd.h>
+#endif
+//------------------------------------------------------------------------------
+#include "scope_exit.hpp"
+#include "indexer.hpp"
+#include "cdc512.hpp"
+#include "block_reader.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+namespace tests {
+//------------------------------------------------------------------------------
+void block_reader_test()
+{
+	bool fail = false;
+    string file_name = temp_name();
+
+	try {
+        auto write_file = [] (const string & name) {
+            std::ofstream f(name, std::ios::binary);
+
+            for( uint32_t i = 0; i < 5 * 4096 + 100; i++ )
+                f.put(char(i * 2654435761u >> 24));
+        };
+
+        write_file(file_name);
+
+        auto digests = [&] (block_reader & br) {
+            std::vector<uint8_t> r;
+            auto block = [&] (const uint8_t * data) {
+                cdc512 ctx(data, data + br.block_size_);
+                r.insert(r.end(), std::cbegin(ctx.digest), std::cend(ctx.digest));
+                return true;
+            };
+
+            if( !br.read(file_name, block) )
+                throw std::runtime_error("block_reader read failed");
+
+            if( br.blocks_ != 6 )
+                throw std::runtime_error("bad block_reader blocks count");
+
+            return r;
+        };
+
+        block_reader stream, mapped;
+        // several windows with tail in the last one
+        mapped.mmap_threshold_ = 1;
+        mapped.mmap_window_ = 8192;
+
+        if( digests(stream) != digests(mapped) )
+            throw std::runtime_error("bad block_reader mapped read");
+
+        block_reader large;
+        large.read_size_ = 8192;
+        large.drop_cache_ = true;
+
+        if( digests(stream) != digests(large) )
+            throw std::runtime_error("bad block_reader large read");
+
+        large.direct_io_ = true;
+
+        if( digests(stream) != digests(large) )
+            throw std::runtime_error("bad block_reader direct read");
+
+#if HAVE_IO_URING
+        // small file, file not smaller than limit and absent file
+        try {
+            uring_file_reader ur(2, 4096);
+            string small_name = file_name + CPPX_U(".small");
+
+            std::ofstream(small_name, std::ios::binary) << "small file content";
+
+            ur.add(small_name, 0);
+            ur.add(file_name, 1);
+            ur.add(file_name + CPPX_U(".absent"), 2);
+
+            std::vector<std::vector<uint8_t>> contents(3);
+            std::vector<bool> read(3);
+
+            auto on_file = [&] (uint64_t tag, const uint8_t * data, size_t size) {
+                read[tag] = true;
+
+                if( data != nullptr )
+                    contents[tag].assign(data, data + size);
+            };
+
+            ur.run(on_file);
+            std::remove(str2utf(small_name).c_str());
+
+            if( !read[0] || !read[1] || !read[2] || ur.size() != 0
+                || std::string(contents[0].begin(), contents[0].end()) != "small file content"
+                || !contents[1].empty() || !contents[2].empty() )
+                throw std::logic_error("bad uring_file_reader implementation");
+        }
+        catch( const std::runtime_error & ) {
+            // io_uring is disabled or not supported by kernel
+        }
+#endif
+#if __linux__
+        // file truncated while its window is hashed fails the read, file
+        // truncated before the next window is read up to its new end
+        {
+            string trunc_name = file_name + CPPX_U(".trunc");
+            at_scope_exit( std::remove(str2utf(trunc_name).c_str()) );
+
+            bool truncated = false;
+            uint64_t sum = 0;
+
+            auto touch = [&] (const uint8_t * blocks, size_t count) {
+                if( !truncated )
+                    truncated = ::truncate(trunc_name.c_str(), 0) == 0;
+
+                for( size_t i = 0; i < count * mapped.block_size_; i++ )
+                    sum += blocks[i];
+
+                return true;
+            };
+
+            write_file(trunc_name);
+
+            if( mapped.read_runs(trunc_name, touch) || !truncated )
+                throw std::runtime_error("bad block_reader truncated mapping");
+
+            auto shrink = [&] (const uint8_t *, size_t) {
+                if( !truncated )
+                    truncated = ::truncate(trunc_name.c_str(), 8192 + 100) == 0;
+
+                return true;
+            };
+
+            write_file(trunc_name);
+            truncated = false;
+
+            if( !mapped.read_runs(trunc_name, shrink) || mapped.bytes_ != 8192 + 100 )
+                throw std::runtime_error("bad block_reader shrunk file");
+        }
+#endif
+        uint64_t n = 0;
+        auto stop = [&] (const uint8_t *) {
+            return ++n < 2;
+        };
+
+        if( stream.read(file_name, stop) || n != 2 )
+            throw std::runtime_error("bad block_reader stop");
+
+        if( stream.read(file_name + CPPX_U(".absent"), stop) )
+            throw std::runtime_error("bad block_reader absent file");
+	}
+    catch (const std::exception & e) {
+        std::cerr << e.what() << std::endl;
+        fail = true;
+    }
+    catch (...) {
+		fail = true;
+	}
+
+    std::remove(str2utf(file_name).c_str());
+
+    std::cerr << "block_reader test " << (fail ? "failed" : "passed") << std::endl;
+}
+//------------------------------------------------------------------------------
+} // namespace tests
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
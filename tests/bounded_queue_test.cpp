@@ -0,0 +1,116 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <iostream>
+#include <stdexcept>
+#include <atomic>
+#include <thread>
+#include <vector>
+//------------------------------------------------------------------------------
+#include "bounded_queue.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+namespace tests {
+//------------------------------------------------------------------------------
+void bounded_queue_test()
+{
+	bool fail = false;
+
+	try {
+        bounded_queue<uint64_t> q(5);
+        uint64_t v = 0;
+
+        for( v = 1; q.try_push(v); v++ );
+
+        if( v != 9 )
+            throw std::runtime_error("bad bounded_queue capacity");
+
+        for( uint64_t i = 1; i < 9; i++ )
+            if( !q.try_pop(v) || v != i )
+                throw std::runtime_error("bad bounded_queue order");
+
+        if( q.try_pop(v) )
+            throw std::runtime_error("bad bounded_queue emptiness");
+
+        // every value pushed by producers is popped exactly once
+        constexpr uintptr_t producers = 4, consumers = 4;
+        constexpr uint64_t count = 100000;
+
+        bounded_queue<uint64_t> mq(64);
+        std::atomic<uint64_t> sum(0), popped(0);
+        std::vector<std::thread> threads;
+
+        for( uintptr_t p = 0; p < producers; p++ )
+            threads.emplace_back([&, p] {
+                backoff idle;
+
+                for( uint64_t i = 1; i <= count; i++ ) {
+                    auto x = p * count + i;
+
+                    while( !mq.try_push(x) )
+                        idle();
+                }
+            });
+
+        for( uintptr_t c = 0; c < consumers; c++ )
+            threads.emplace_back([&] {
+                backoff idle;
+                uint64_t x;
+
+                while( popped < producers * count ) {
+                    if( !mq.try_pop(x) ) {
+                        idle();
+                        continue;
+                    }
+
+                    sum += x;
+                    popped++;
+                }
+            });
+
+        for( auto & t : threads )
+            t.join();
+
+        auto n = producers * count;
+
+        if( sum != n * (n + 1) / 2 )
+            throw std::runtime_error("bad bounded_queue concurrency");
+	}
+    catch (const std::exception & e) {
+        std::cerr << e.what() << std::endl;
+        fail = true;
+    }
+    catch (...) {
+		fail = true;
+	}
+
+    std::cerr << "bounded_queue test " << (fail ? "failed" : "passed") << std::endl;
+}
+//------------------------------------------------------------------------------
+} // namespace tests
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
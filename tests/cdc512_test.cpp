@@ -24,6 +24,9 @@
 //------------------------------------------------------------------------------
 #include <iostream>
 #include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
 //------------------------------------------------------------------------------
 #include "cdc512.hpp"
 //------------------------------------------------------------------------------
@@ -62,6 +65,166 @@ void cdc512_test()
 
         if( ctx2.to_string() != "A0AA-3C5A-2B41-1585-53F4-17E4-F0F1-FE9D-7E68-9734-3B6F-42AB-B641-D3A9-D44E-C426-FC61-C99C-B47B-795A-913B-2A91-8E40-6733-19E0-AF37-4781-B5E0-3BFD-D83F-69DB-3460" )
 			throw std::runtime_error("bad cdc512 implementation");
+
+        // multi buffer digests must be bit exact with one by one ones for every
+        // lanes split and tail length
+        uint8_t bufs[13][4096 + 3];
+        const uint8_t * ptrs[13];
+
+        for( size_t i = 0; i < 13; i++ ) {
+            for( size_t j = 0; j < sizeof(bufs[i]); j++ )
+                bufs[i][j] = uint8_t(i * 131 + j * 7 + (j >> 8));
+
+            // unaligned buffers too
+            ptrs[i] = bufs[i] + (i & 3);
+        }
+
+        // of every kernel supported
+        const std::string selected = cdc512::kernel();
+
+        for( auto kernel : cdc512::kernels() ) {
+            if( !cdc512::kernel(kernel) || cdc512::kernel() != std::string(kernel) )
+                throw std::runtime_error("bad cdc512 kernel selection");
+
+            for( uintptr_t size : { 0, 1, 63, 64, 100, 4096 } )
+                for( size_t n = 1; n <= 13; n++ ) {
+                    uint8_t digests[13][sizeof(cdc512_data)];
+
+                    cdc512::hash_many(ptrs, n, size, digests[0]);
+
+                    for( size_t i = 0; i < n; i++ ) {
+                        cdc512 ctx(ptrs[i], ptrs[i] + size);
+
+                        if( std::memcmp(ctx.digest, digests[i], sizeof(ctx.digest)) != 0 )
+                            throw std::runtime_error("bad cdc512 multi buffer implementation");
+                    }
+                }
+        }
+
+        if( cdc512::kernel("unknown") || !cdc512::kernel(selected.c_str()) )
+            throw std::runtime_error("bad cdc512 kernel selection");
+
+        // tree built leaf by leaf must be the same as built recursively
+        std::function<void (size_t, size_t, uint8_t *)> root = [&] (size_t first, size_t n, uint8_t * digest) {
+            if( n == 1 ) {
+                cdc512 ctx(ptrs[first], ptrs[first] + 64);
+                std::memcpy(digest, ctx.digest, sizeof(ctx.digest));
+                return;
+            }
+
+            size_t left = 1;
+
+            while( left * 2 < n )
+                left *= 2;
+
+            uint8_t children[2][sizeof(cdc512_data)];
+            root(first, left, children[0]);
+            root(first + left, n - left, children[1]);
+
+            cdc512 ctx(children[0], children[0] + sizeof(children));
+            std::memcpy(digest, ctx.digest, sizeof(ctx.digest));
+        };
+
+        cdc512_tree tree;
+
+        for( size_t n = 0; n <= 13; n++ ) {
+            for( size_t i = 0; i < n; i++ ) {
+                cdc512 ctx(ptrs[i], ptrs[i] + 64);
+                tree.add(ctx.digest);
+            }
+
+            uint8_t expected[sizeof(cdc512_data) + sizeof(uint64_t)];
+            size_t size = 0;
+
+            if( n != 0 ) {
+                root(0, n, expected);
+                size = sizeof(cdc512_data);
+            }
+
+            uint64_t leaves = vhtobe64(n);
+            std::memcpy(expected + size, &leaves, sizeof(leaves));
+
+            cdc512 ctx(expected, expected + size + sizeof(leaves));
+            std::vector<uint8_t> digest;
+            tree.finish(digest);
+
+            if( digest.size() != sizeof(ctx.digest) || std::memcmp(ctx.digest, &digest[0], digest.size()) != 0 )
+                throw std::runtime_error("bad cdc512 tree implementation");
+        }
+
+        // hashing continued from saved state must give the same digest as
+        // uninterrupted one
+        for( uintptr_t cut : { 0, 64, 1024, 4032 } ) {
+            cdc512 whole(ptrs[0], ptrs[0] + 4096), head;
+            head.update(ptrs[0], cut);
+
+            uint8_t state[cdc512::state_size];
+            head.save(state);
+
+            cdc512 tail(leave_uninitialized);
+
+            if( !tail.load(state, sizeof(state), cut) )
+                throw std::runtime_error("bad cdc512 state load");
+
+            tail.update(ptrs[0] + cut, 4096 - cut);
+            tail.finish();
+
+            if( std::memcmp(whole.digest, tail.digest, sizeof(whole.digest)) != 0 )
+                throw std::runtime_error("bad cdc512 state save/load");
+
+            // truncated state, state of blocks of another size
+            if( tail.load(state, sizeof(state) - 1, cut)
+                || (cut != 0 && tail.load(state, sizeof(state), cut * 2))
+                || tail.load(state, sizeof(state), cut + 1) )
+                throw std::runtime_error("bad cdc512 state load");
+        }
+
+        for( size_t n = 0; n <= 13; n++ )
+            for( size_t cut = 0; cut <= n; cut++ ) {
+                cdc512_tree whole, head, tail;
+                std::vector<uint8_t> expected, digest, state;
+
+                for( size_t i = 0; i < n; i++ ) {
+                    cdc512 ctx(ptrs[i], ptrs[i] + 64);
+                    whole.add(ctx.digest);
+
+                    if( i < cut )
+                        head.add(ctx.digest);
+                }
+
+                head.save(state);
+
+                if( !tail.load(state.data(), state.size()) || tail.leaves() != cut )
+                    throw std::runtime_error("bad cdc512 tree state load");
+
+                for( size_t i = cut; i < n; i++ ) {
+                    cdc512 ctx(ptrs[i], ptrs[i] + 64);
+                    tail.add(ctx.digest);
+                }
+
+                whole.finish(expected);
+                tail.finish(digest);
+
+                if( digest != expected )
+                    throw std::runtime_error("bad cdc512 tree state save/load");
+
+                // truncated state
+                if( tail.load(state.data(), state.size() - 1)
+                    || (state.size() > sizeof(uint64_t) && tail.load(state.data(), state.size() - sizeof(uint64_t) - sizeof(cdc512_data))) )
+                    throw std::runtime_error("bad cdc512 tree state load");
+
+                // garbled leaves count of tree, of its first subtree
+                for( size_t offset : { size_t(7), sizeof(uint64_t) + 7 } ) {
+                    if( offset >= state.size() )
+                        continue;
+
+                    auto garbled = state;
+                    garbled[offset] ^= 3;
+
+                    if( tail.load(garbled.data(), garbled.size()) )
+                        throw std::runtime_error("bad cdc512 tree state load");
+                }
+            }
 	}
     catch (const std::exception & e) {
         std::cerr << e.what() << std::endl;
@@ -0,0 +1,139 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+//------------------------------------------------------------------------------
+#include "cdc512.hpp"
+#include "chunker.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+namespace tests {
+//------------------------------------------------------------------------------
+void chunker_test()
+{
+	bool fail = false;
+
+	try {
+        std::vector<uint8_t> data(1024 * 1024);
+        uint64_t x = 88172645463325252;
+
+        for( auto & b : data ) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            b = uint8_t(x >> 32);
+        }
+
+        content_chunker chunker(0, 8192, 0);
+
+        if( chunker.min_size() != 2048 || chunker.max_size() != 65536 )
+            throw std::runtime_error("bad content_chunker default sizes");
+
+        // chunks of data given in pieces of size piece, 0 for whole at once
+        auto chunks = [&] (const std::vector<uint8_t> & d, size_t piece) {
+            std::vector<size_t> lengths;
+            size_t length = 0;
+
+            chunker.reset();
+
+            for( size_t offset = 0; offset < d.size(); ) {
+                size_t size = piece == 0 ? d.size() - offset : std::min(piece, d.size() - offset);
+                bool cut;
+                size_t n = chunker.scan(&d[offset], size, cut);
+
+                offset += n;
+                length += n;
+
+                if( cut ) {
+                    lengths.push_back(length);
+                    length = 0;
+                }
+            }
+
+            if( length != 0 )
+                lengths.push_back(length);
+
+            return lengths;
+        };
+
+        auto whole = chunks(data, 0);
+
+        for( size_t i = 0; i + 1 < whole.size(); i++ )
+            if( whole[i] < chunker.min_size() || whole[i] > chunker.max_size() )
+                throw std::runtime_error("bad content_chunker chunk size");
+
+        if( whole.size() < 64 || whole.size() > 256 )
+            throw std::runtime_error("bad content_chunker average size");
+
+        for( size_t piece : { 1, 1000, 4096, 100000 } )
+            if( chunks(data, piece) != whole )
+                throw std::runtime_error("bad content_chunker streaming");
+
+        // inserted byte changes only chunks around it
+        auto digests = [&] (const std::vector<uint8_t> & d) {
+            std::set<std::string> set;
+            size_t offset = 0;
+
+            for( auto length : chunks(d, 0) ) {
+                set.insert(cdc512(&d[offset], &d[offset] + length).to_string());
+                offset += length;
+            }
+
+            return set;
+        };
+
+        auto before = digests(data);
+        data.insert(data.begin() + 100, 0x55);
+        auto after = digests(data);
+
+        size_t common = 0;
+
+        for( const auto & d : after )
+            common += before.count(d);
+
+        if( common + 2 < before.size() )
+            throw std::runtime_error("bad content_chunker shift resistance");
+	}
+    catch (const std::exception & e) {
+        std::cerr << e.what() << std::endl;
+        fail = true;
+    }
+    catch (...) {
+		fail = true;
+	}
+
+    std::cerr << "chunker test " << (fail ? "failed" : "passed") << std::endl;
+}
+//------------------------------------------------------------------------------
+} // namespace tests
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
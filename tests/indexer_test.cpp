@@ -22,10 +22,19 @@
  * THE SOFTWARE.
  */
 //------------------------------------------------------------------------------
+#include <cstdio>
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <tuple>
+#include <cstring>
+#include <fstream>
+#if __linux__
+#include <unistd.h>
+#include <utime.h>
+#endif
 //------------------------------------------------------------------------------
+#include "cdc512.hpp"
 #include "indexer.hpp"
 //------------------------------------------------------------------------------
 namespace spacenet {
@@ -64,6 +73,21 @@ void indexer_test()
 
         dr.read(get_cwd());
 
+        size_t batched = 0, regular = 0;
+        auto visitor = [&] (const directory_batch & batch) {
+            batched += batch.size();
+
+            for( size_t i = 0; i < batch.size(); i++ )
+                if( batch.types[i] == directory_batch::regular )
+                    regular++;
+        };
+
+        dr.read_batches(get_cwd(), visitor);
+
+        if( batched != lst.size() || regular != size_t(std::count_if(lst.begin(), lst.end(),
+                [] (const auto & e) { return e.is_reg_; })) )
+            throw std::runtime_error("directory_reader batches mismatch");
+
 		locale_traits<char> comparator;
 
 		std::function<bool (const entry & a, const entry & b)> sorter = [&] (const auto & a, const auto & b) {
@@ -83,6 +107,7 @@ void indexer_test()
 		directory_indexer di;
         //string db_name = temp_path(false) + CPPX_U("indexer_test.sqlite");
         string db_name = temp_name() + CPPX_U(".sqlite");
+        at_scope_exit( std::remove(str2utf(db_name).c_str()) );
 		
 		//sqlite::sqlite_config db_config;
         //db_config.flags = sqlite::OpenFlags::READWRITE | sqlite::OpenFlags::CREATE;
@@ -103,8 +128,456 @@ void indexer_test()
 		
 		pragmas.execute_all();
 		
+        // journal of database not indexed yet is empty and schema isn't created
+        {
+            sqlite3pp::query st(db, "SELECT COUNT(*) FROM sqlite_master");
+
+            if( !di.changes(db, 0).empty() || st.begin()->get<uint64_t>(0) != 0 )
+                throw std::runtime_error("directory_indexer changes of empty database");
+        }
+
+        di.reindex(db, get_cwd());
+
+        auto entries_count = [&] {
+            sqlite3pp::query st(db, "SELECT COUNT(*) FROM entries");
+            return st.begin()->get<uint64_t>(0);
+        };
+
+        auto full_count = entries_count();
+
+        auto journal = di.changes(db, 0);
+
+        if( journal.empty() || journal.size() < full_count )
+            throw std::runtime_error("directory_indexer changes journal incomplete");
+
+        for( size_t i = 1; i < journal.size(); i++ )
+            if( journal[i].seq <= journal[i - 1].seq )
+                throw std::runtime_error("directory_indexer changes journal unordered");
+
+        // second incremental pass trusts stamps stored by the first one
+        di.incremental(true);
+        di.reindex(db, get_cwd());
         di.reindex(db, get_cwd());
 
+        if( entries_count() != full_count )
+            throw std::runtime_error("directory_indexer incremental reindex mismatch");
+
+        if( !di.changes(db, journal.back().seq).empty() )
+            throw std::runtime_error("directory_indexer journaled unchanged entries");
+
+        // pipelined engine must give the same index
+        string pdb_name = temp_name() + CPPX_U(".sqlite");
+        at_scope_exit( std::remove(str2utf(pdb_name).c_str()) );
+        sqlite3pp::database pdb(str2utf(pdb_name));
+
+        directory_indexer pdi;
+#if HAVE_IO_URING
+        pdi.uring_depth(8);
+#endif
+        pdi.threads(4).reindex(pdb, get_cwd());
+
+        auto digests = [] (sqlite3pp::database & db) {
+            sqlite3pp::query st(db, R"EOS(
+                SELECT
+                    COUNT(*),
+                    COUNT(digest),
+                    (SELECT COUNT(*) FROM blocks_digests)
+                FROM
+                    entries
+            )EOS");
+
+            auto i = st.begin();
+
+            return std::make_tuple(i->get<uint64_t>(0), i->get<uint64_t>(1), i->get<uint64_t>(2));
+        };
+
+        if( digests(pdb) != digests(db) )
+            throw std::runtime_error("directory_indexer pipelined reindex mismatch");
+
+        // switch of digest mode rehashes files, their digests are then roots
+        // of trees of stored block digests
+        pdi.digest_mode(directory_indexer::merkle_digest).reindex(pdb, get_cwd());
+
+        if( digests(pdb) != digests(db) )
+            throw std::runtime_error("directory_indexer merkle reindex mismatch");
+
+        auto check_merkle = [&] {
+            sqlite3pp::query st_files(pdb, R"EOS(
+                SELECT
+                    rowid,
+                    digest,
+                    digest_mode
+                FROM
+                    entries
+                WHERE
+                    digest IS NOT NULL
+            )EOS");
+
+            sqlite3pp::query st_blocks(pdb, R"EOS(
+                SELECT
+                    digest
+                FROM
+                    blocks_digests
+                WHERE
+                    entry_id = :entry_id
+                ORDER BY
+                    block_no
+            )EOS");
+
+            for( auto i = st_files.begin(); i != st_files.end(); ++i ) {
+                if( i->get<int>(2) != directory_indexer::merkle_digest )
+                    throw std::runtime_error("directory_indexer digest mode not stored");
+
+                cdc512_tree tree;
+                st_blocks.bind("entry_id", i->get<uint64_t>(0));
+
+                for( auto j = st_blocks.begin(); j != st_blocks.end(); ++j )
+                    tree.add(static_cast<const uint8_t *>(j->get<const void *>(0)));
+
+                st_blocks.reset();
+
+                std::vector<uint8_t> digest;
+                tree.finish(digest);
+
+                if( std::memcmp(&digest[0], i->get<const void *>(1), digest.size()) != 0 )
+                    throw std::runtime_error("directory_indexer merkle digest mismatch");
+            }
+        };
+
+        check_merkle();
+
+        // content defined chunks cover whole files without gaps
+        pdi.chunk_avg_size(1024).reindex(pdb, get_cwd());
+
+        check_merkle();
+
+        sqlite3pp::query st_chunks(pdb, R"EOS(
+            SELECT
+                COUNT(*)
+            FROM
+                entries e
+            WHERE
+                digest IS NOT NULL
+                AND (
+                    chunking IS NULL
+                    OR IFNULL(file_size, 0) <> (
+                        SELECT IFNULL(SUM(length), 0) FROM blocks_digests b WHERE b.entry_id = e.rowid
+                    )
+                    OR EXISTS (
+                        SELECT * FROM blocks_digests b WHERE b.entry_id = e.rowid AND (
+                            length IS NULL
+                            OR offset <> (
+                                SELECT IFNULL(SUM(length), 0) FROM blocks_digests p
+                                WHERE p.entry_id = b.entry_id AND p.block_no < b.block_no
+                            )
+                        )
+                    )
+                )
+        )EOS");
+
+        if( st_chunks.begin()->get<uint64_t>(0) != 0 )
+            throw std::runtime_error("directory_indexer content defined chunks mismatch");
+#if __linux__
+        // grown file is hashed on from its last full block and gets the same
+        // digests as if it were hashed from the start
+        string log_dir = temp_name();
+        string log_name = log_dir + path_delimiter + CPPX_U("log");
+        at_scope_exit(
+            ::unlink(log_name.c_str());
+            ::rmdir(log_dir.c_str());
+        );
+
+        mkdir(log_dir);
+
+        auto write_log = [&] (std::ios::openmode mode, size_t size, uint8_t seed, time_t mtime) {
+            {
+                std::ofstream f(log_name, std::ios::binary | mode);
+
+                for( size_t i = 0; i < size; i++ )
+                    f.put(char(uint8_t(i * 2654435761u >> 24) ^ seed));
+            }
+
+            struct utimbuf times = { mtime, mtime };
+            ::utime(log_name.c_str(), &times);
+        };
+
+        auto log_digests = [&] (sqlite3pp::database & ldb) {
+            sqlite3pp::query st(ldb, R"EOS(
+                SELECT
+                    hex(digest) || ':' || (
+                        SELECT group_concat(hex(digest), ',') FROM (
+                            SELECT digest FROM blocks_digests WHERE entry_id = e.rowid ORDER BY block_no
+                        )
+                    )
+                FROM
+                    entries e
+                WHERE
+                    digest IS NOT NULL
+            )EOS");
+
+            return st.begin()->get<std::string>(0);
+        };
+
+        for( auto mode : { directory_indexer::sequential_digest, directory_indexer::merkle_digest } ) {
+            string adb_name = temp_name() + CPPX_U(".sqlite");
+            sqlite3pp::database adb(str2utf(adb_name));
+            at_scope_exit( ::unlink(adb_name.c_str()) );
+
+            directory_indexer adi;
+            adi.digest_mode(mode).detect_appends(true);
+
+            time_t now = ::time(nullptr);
+
+            write_log(std::ios::trunc, 3 * 4096 + 100, 0, now);
+            adi.reindex(adb, log_dir);
+
+            // appended, then rewritten and grown
+            for( int step = 1; step <= 2; step++ ) {
+                if( step == 1 )
+                    write_log(std::ios::app, 2 * 4096 + 50, 0, now + 100);
+                else
+                    write_log(std::ios::trunc, 6 * 4096, 0x5a, now + 200);
+
+                adi.reindex(adb, log_dir);
+
+                string fdb_name = temp_name() + CPPX_U(".sqlite");
+                sqlite3pp::database fdb(str2utf(fdb_name));
+                at_scope_exit( ::unlink(fdb_name.c_str()) );
+
+                directory_indexer fdi;
+                fdi.digest_mode(mode).reindex(fdb, log_dir);
+
+                if( log_digests(adb) != log_digests(fdb) )
+                    throw std::runtime_error("directory_indexer append detection mismatch");
+            }
+        }
+
+        // touched file with sampled blocks unchanged keeps its digest until
+        // it is verified, changed one is rehashed at once
+        {
+            string sdb_name = temp_name() + CPPX_U(".sqlite");
+            sqlite3pp::database sdb(str2utf(sdb_name));
+            at_scope_exit( ::unlink(sdb_name.c_str()) );
+
+            directory_indexer sdi;
+            sdi.precheck_size(1).verify_limit(0);
+
+            time_t now = ::time(nullptr);
+
+            write_log(std::ios::trunc, 5 * 4096, 0, now);
+            sdi.reindex(sdb, log_dir);
+
+            auto digests_before = log_digests(sdb);
+            auto deferred = [&] {
+                sqlite3pp::query st(sdb, "SELECT COUNT(*) FROM entries WHERE deferred IS NOT NULL");
+                return st.begin()->get<uint64_t>(0);
+            };
+
+            auto seq_before = sdi.changes(sdb, 0).back().seq;
+
+            write_log(std::ios::trunc, 5 * 4096, 0, now + 100);
+            sdi.reindex(sdb, log_dir);
+
+            if( deferred() != 1 || log_digests(sdb) != digests_before )
+                throw std::runtime_error("directory_indexer pre-check didn't defer");
+
+            // deferred entry got new mtime, so it is journaled as modified
+            auto deferred_changes = sdi.changes(sdb, seq_before);
+
+            if( deferred_changes.size() != 1 || deferred_changes[0].kind != entry_change::modified )
+                throw std::runtime_error("directory_indexer deferred entry isn't journaled");
+
+            sdi.verify_limit(1).reindex(sdb, log_dir);
+
+            if( deferred() != 0 || log_digests(sdb) != digests_before )
+                throw std::runtime_error("directory_indexer deferred verification mismatch");
+
+            // in dirty mode deferred file is verified before its directory
+            // entries are revived
+            write_log(std::ios::trunc, 5 * 4096, 0, now + 150);
+            sdi.verify_limit(0).reindex(sdb, log_dir);
+
+            if( deferred() != 1 )
+                throw std::runtime_error("directory_indexer pre-check didn't defer");
+
+            std::vector<string> dirty = { log_dir };
+            sdi.verify_limit(1).reindex(sdb, log_dir, nullptr, &dirty);
+
+            sqlite3pp::query st_alive(sdb, "SELECT COUNT(*) FROM entries WHERE is_dir IS NULL AND is_alive <> 1");
+
+            if( deferred() != 0 || log_digests(sdb) != digests_before || st_alive.begin()->get<uint64_t>(0) != 0 )
+                throw std::runtime_error("directory_indexer dirty deferred verification mismatch");
+
+            write_log(std::ios::trunc, 5 * 4096, 0x5a, now + 200);
+            sdi.reindex(sdb, log_dir);
+
+            string fdb_name = temp_name() + CPPX_U(".sqlite");
+            sqlite3pp::database fdb(str2utf(fdb_name));
+            at_scope_exit( ::unlink(fdb_name.c_str()) );
+
+            directory_indexer().reindex(fdb, log_dir);
+
+            if( deferred() != 0 || log_digests(sdb) != log_digests(fdb) )
+                throw std::runtime_error("directory_indexer pre-check missed change");
+        }
+
+        // large file is split into larger blocks, change of policy rehashes it
+        {
+            string bdb_name = temp_name() + CPPX_U(".sqlite");
+            sqlite3pp::database bdb(str2utf(bdb_name));
+            at_scope_exit( ::unlink(bdb_name.c_str()) );
+
+            const size_t size = 4096 * 4096 + 1;
+            write_log(std::ios::trunc, size, 0, ::time(nullptr));
+
+            auto blocks = [&] (size_t block_size) {
+                sqlite3pp::query st(bdb, R"EOS(
+                    SELECT
+                        e.block_size,
+                        COUNT(*),
+                        (SELECT digest FROM blocks_digests WHERE entry_id = e.rowid AND block_no = 1)
+                    FROM
+                        entries e JOIN blocks_digests b ON b.entry_id = e.rowid
+                    WHERE
+                        e.digest IS NOT NULL
+                )EOS");
+
+                auto i = st.begin();
+
+                std::vector<char> head(block_size);
+                std::ifstream(log_name, std::ios::binary).read(&head[0], head.size());
+                cdc512 ctx(head.begin(), head.end());
+
+                if( i->get<uint64_t>(0) != block_size
+                    || i->get<uint64_t>(1) != (size + block_size - 1) / block_size
+                    || std::memcmp(i->get<const void *>(2), ctx.digest, i->column_bytes(2)) != 0 )
+                    throw std::runtime_error("directory_indexer adaptive block size mismatch");
+            };
+
+            directory_indexer bdi;
+            bdi.max_block_size(1024 * 1024).threads(2).reindex(bdb, log_dir);
+            blocks(8192);
+
+            bdi.max_block_size(0).threads(0).reindex(bdb, log_dir);
+            blocks(4096);
+        }
+
+        // interrupted hashing is resumed from checkpoint, blocks before it
+        // aren't hashed again
+        for( uintptr_t threads : { 0, 2 } ) {
+            string cdb_name = temp_name() + CPPX_U(".sqlite");
+            sqlite3pp::database cdb(str2utf(cdb_name));
+            at_scope_exit( ::unlink(cdb_name.c_str()) );
+
+            write_log(std::ios::trunc, 10 * 4096 + 10, 0, ::time(nullptr));
+
+            directory_indexer cdi;
+            cdi.checkpoint_size(4096).threads(threads).reindex(cdb, log_dir);
+
+            auto expected = log_digests(cdb);
+
+            std::vector<char> head(4 * 4096);
+            std::ifstream(log_name, std::ios::binary).read(&head[0], head.size());
+
+            cdc512 ctx;
+            ctx.update(head.begin(), head.end());
+
+            std::vector<uint8_t> state(cdc512::state_size);
+            ctx.save(&state[0]);
+
+            sqlite3pp::command st_interrupt(cdb, R"EOS(
+                UPDATE entries SET
+                    checkpoint_mtime = mtime,
+                    checkpoint_block = 4,
+                    checkpoint_state = :state,
+                    mtime = NULL,
+                    digest = NULL
+                WHERE
+                    digest IS NOT NULL
+            )EOS");
+
+            st_interrupt.bind("state", state, sqlite3pp::nocopy);
+            st_interrupt.execute();
+            cdb.execute("UPDATE blocks_digests SET digest = zeroblob(64) WHERE block_no < 4");
+
+            cdi.reindex(cdb, log_dir);
+
+            sqlite3pp::query st(cdb, R"EOS(
+                SELECT
+                    COUNT(*)
+                FROM
+                    entries e JOIN blocks_digests b ON b.entry_id = e.rowid
+                WHERE
+                    b.digest = zeroblob(64)
+                    AND e.digest IS NOT NULL
+                    AND e.checkpoint_block IS NULL
+            )EOS");
+
+            if( st.begin()->get<uint64_t>(0) != 3 )
+                throw std::runtime_error("directory_indexer checkpoint not resumed");
+
+            // digest of file and of blocks after checkpoint
+            auto tail = [] (const std::string & digests) {
+                return digests.substr(0, digests.find(':')) + digests.substr(digests.find(':') + 3 * 129);
+            };
+
+            if( tail(log_digests(cdb)) != tail(expected) )
+                throw std::runtime_error("directory_indexer checkpoint resume mismatch");
+        }
+
+        // leading parts of block digests are stored, file digest is whole,
+        // change of width rehashes file
+        {
+            string wdb_name = temp_name() + CPPX_U(".sqlite");
+            sqlite3pp::database wdb(str2utf(wdb_name));
+            at_scope_exit( ::unlink(wdb_name.c_str()) );
+
+            write_log(std::ios::trunc, 10 * 4096 + 10, 0, ::time(nullptr));
+
+            // digests of file and leading parts of its block digests
+            auto truncated = [] (sqlite3pp::database & ldb, int width, int stored_width) {
+                sqlite3pp::query st(ldb, R"EOS(
+                    SELECT
+                        hex(digest) || ':' || (
+                            SELECT group_concat(hex(substr(digest, 1, :width)), ',') FROM (
+                                SELECT digest FROM blocks_digests WHERE entry_id = e.rowid ORDER BY block_no
+                            )
+                        ),
+                        (SELECT MAX(length(digest)) FROM blocks_digests WHERE entry_id = e.rowid)
+                    FROM
+                        entries e
+                    WHERE
+                        digest IS NOT NULL
+                )EOS");
+
+                st.bind("width", width);
+                auto i = st.begin();
+
+                if( i->get<int>(1) != stored_width )
+                    throw std::runtime_error("directory_indexer block digest width mismatch");
+
+                return i->get<std::string>(0);
+            };
+
+            directory_indexer wdi;
+            wdi.reindex(wdb, log_dir);
+
+            auto whole = truncated(wdb, 64, 64);
+            auto expected = truncated(wdb, 16, 64);
+
+            for( uintptr_t threads : { 0, 2 } ) {
+                wdi.block_digest_size(16).threads(threads).reindex(wdb, log_dir);
+
+                if( truncated(wdb, 16, 16) != expected )
+                    throw std::runtime_error("directory_indexer truncated block digests mismatch");
+
+                wdi.block_digest_size(64).reindex(wdb, log_dir);
+
+                if( truncated(wdb, 64, 64) != whole )
+                    throw std::runtime_error("directory_indexer truncated block digests mismatch");
+            }
+        }
+#endif
 	}
     catch (const std::exception & e) {
         std::cerr << e.what() << std::endl;
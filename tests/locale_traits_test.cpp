@@ -25,8 +25,10 @@
 #include <iostream>
 //------------------------------------------------------------------------------
 #include "locale_traits.hpp"
+#if _WIN32
 #include "windows.h"
 #include "winnls.h"
+#endif
 //------------------------------------------------------------------------------
 namespace spacenet {
 //------------------------------------------------------------------------------
@@ -0,0 +1,127 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+#include <iostream>
+//------------------------------------------------------------------------------
+#include "indexer.hpp"
+#include "matcher.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+namespace tests {
+//------------------------------------------------------------------------------
+void matcher_test()
+{
+	bool fail = false;
+
+	try {
+        struct {
+            const string::value_type * patterns;
+            const string::value_type * name;
+            bool result;
+        } cases[] = {
+            { CPPX_U("*"),                  CPPX_U("abc"),          true  },
+            { CPPX_U("abc"),                CPPX_U("abc"),          true  },
+            { CPPX_U("abc"),                CPPX_U("abcd"),         false },
+            { CPPX_U("*.tmp"),              CPPX_U("a.tmp"),        true  },
+            { CPPX_U("*.tmp"),              CPPX_U(".tmp"),         true  },
+            { CPPX_U("*.tmp"),              CPPX_U("a.tmpx"),       false },
+            { CPPX_U("*.tmp;*.bak"),        CPPX_U("a.bak"),        true  },
+            { CPPX_U("a*c"),                CPPX_U("abbbc"),        true  },
+            { CPPX_U("a*c"),                CPPX_U("abbbcd"),       false },
+            { CPPX_U("a*b*c"),              CPPX_U("axxbyyc"),      true  },
+            { CPPX_U("a*b*c"),              CPPX_U("axxcyyb"),      false },
+            { CPPX_U("?.txt"),              CPPX_U("a.txt"),        true  },
+            { CPPX_U("?.txt"),              CPPX_U("ab.txt"),       false },
+            { CPPX_U("[a-c]x"),             CPPX_U("bx"),           true  },
+            { CPPX_U("[a-c]x"),             CPPX_U("dx"),           false },
+            { CPPX_U("[!a-c]x"),            CPPX_U("dx"),           true  },
+            { CPPX_U("[]]x"),               CPPX_U("]x"),           true  },
+            { CPPX_U("[ab"),                CPPX_U("[ab"),          true  },
+            { CPPX_U("node_modules;*.o"),   CPPX_U("node_modules"), true  },
+            { CPPX_U("x*;*.o;lib*.so"),     CPPX_U("libz.so"),      true  },
+            { CPPX_U("x*;*.o;lib*.so"),     CPPX_U("libz.a"),       false },
+        };
+
+        for( const auto & c : cases ) {
+            name_matcher m(c.patterns);
+
+            // twice, second time from DFA cache
+            if( m.match(c.name) != c.result || m.match(c.name) != c.result )
+                throw std::runtime_error("bad name matcher implementation: "
+                    + str2utf(c.patterns) + " " + str2utf(c.name));
+        }
+
+        name_matcher r(CPPX_U(".*\\.tmp"), true);
+
+        if( !r.match(CPPX_U("a.tmp")) || r.match(CPPX_U("a.tmpx")) )
+            throw std::runtime_error("bad name matcher regex fallback");
+
+        string d = path_delimiter;
+        auto root = ignore_list::parse(nullptr, CPPX_U("r"),
+            "# comment\nnode_modules/\n*.o\n!keep.o\n/build\ndocs/**/*.tmp\n");
+        auto sub = ignore_list::parse(root, CPPX_U("r") + d + CPPX_U("src"), "!*.o\n");
+
+        struct {
+            const ignore_list * list;
+            string path_name;
+            bool is_dir;
+            bool result;
+        } ignores[] = {
+            { root.get(), CPPX_U("r") + d + CPPX_U("node_modules"),                           true,  true  },
+            { root.get(), CPPX_U("r") + d + CPPX_U("node_modules"),                           false, false },
+            { root.get(), CPPX_U("r") + d + CPPX_U("a") + d + CPPX_U("node_modules"),         true,  true  },
+            { root.get(), CPPX_U("r") + d + CPPX_U("x.o"),                                    false, true  },
+            { root.get(), CPPX_U("r") + d + CPPX_U("keep.o"),                                 false, false },
+            { root.get(), CPPX_U("r") + d + CPPX_U("build"),                                  true,  true  },
+            { root.get(), CPPX_U("r") + d + CPPX_U("a") + d + CPPX_U("build"),                true,  false },
+            { root.get(), CPPX_U("r") + d + CPPX_U("docs") + d + CPPX_U("x.tmp"),             false, true  },
+            { root.get(), CPPX_U("r") + d + CPPX_U("docs") + d + CPPX_U("a") + d + CPPX_U("b") + d + CPPX_U("x.tmp"), false, true },
+            { root.get(), CPPX_U("r") + d + CPPX_U("x.tmp"),                                  false, false },
+            { sub.get(),  CPPX_U("r") + d + CPPX_U("src") + d + CPPX_U("x.o"),                false, false },
+            { sub.get(),  CPPX_U("r") + d + CPPX_U("src") + d + CPPX_U("node_modules"),       true,  true  },
+        };
+
+        for( const auto & c : ignores ) {
+            auto name = c.path_name.substr(c.path_name.rfind(path_delimiter[0]) + 1);
+
+            if( c.list->ignored(c.path_name, name, c.is_dir) != c.result )
+                throw std::runtime_error("bad ignore list implementation: " + str2utf(c.path_name));
+        }
+	}
+    catch (const std::exception & e) {
+        std::cerr << e.what() << std::endl;
+        fail = true;
+    }
+    catch (...) {
+		fail = true;
+	}
+
+    std::cerr << "matcher test " << (fail ? "failed" : "passed") << std::endl;
+}
+//------------------------------------------------------------------------------
+} // namespace tests
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
@@ -0,0 +1,136 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+//------------------------------------------------------------------------------
+#include "mounts.hpp"
+#include "indexer.hpp"
+//------------------------------------------------------------------------------
+#if !_WIN32
+#include <unistd.h>
+#endif
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+namespace tests {
+//------------------------------------------------------------------------------
+void mounts_test()
+{
+	bool fail = false;
+
+	try {
+        mount_table mt;
+
+        mt.parse_mountinfo(
+            "22 1 8:1 / / rw,relatime shared:1 - ext4 /dev/sda1 rw\n"
+            "23 22 0:21 / /proc rw,nosuid shared:12 - proc proc rw\n"
+            "24 22 0:22 / /run rw,nosuid shared:5 - tmpfs tmpfs rw,mode=755\n"
+            "25 22 8:2 / /home/my\\040files rw,relatime shared:2 master:1 - xfs /dev/sda2 rw\n"
+            "26 22 0:45 / /mnt/share rw - nfs4 server:/export rw\n"
+            "bad line\n");
+
+        if( mt.size() != 5 )
+            throw std::runtime_error("bad mountinfo parser implementation");
+
+        auto mp = mt.find(CPPX_U("/home/my files"));
+
+        if( mp == nullptr || mp->skip || mp->type != CPPX_U("xfs") || mp->source != CPPX_U("/dev/sda2") )
+            throw std::runtime_error("bad mountinfo unescape implementation");
+
+        if( !mt.find(CPPX_U("/proc"))->skip || mt.find(CPPX_U("/run"))->skip
+            || !mt.find(CPPX_U("/mnt/share"))->skip || mt.find(CPPX_U("/"))->skip )
+            throw std::runtime_error("bad default mount policy");
+
+        mt.skip_type(CPPX_U("tmpfs")).skip_path(CPPX_U("/home/my files"));
+
+        if( !mt.find(CPPX_U("/run"))->skip || !mt.find(CPPX_U("/home/my files"))->skip )
+            throw std::runtime_error("bad mount policy override");
+
+        if( mt.find(CPPX_U("/mnt")) != nullptr )
+            throw std::runtime_error("bad mount point lookup");
+#if __linux__
+        // skipped mount is found when reader root is given through symlink
+        string root = temp_name();
+        string mnt = root + path_delimiter + CPPX_U("mnt");
+        string sub = mnt + path_delimiter + CPPX_U("sub");
+        string link = temp_name();
+
+        at_scope_exit(
+            ::unlink(link.c_str());
+            ::rmdir(sub.c_str());
+            ::rmdir(mnt.c_str());
+            ::rmdir(root.c_str());
+        );
+
+        mkdir(root);
+        mkdir(mnt);
+        mkdir(sub);
+
+        if( ::symlink(root.c_str(), link.c_str()) != 0 )
+            throw std::runtime_error("failed to create symlink");
+
+        char * canonical = ::realpath(mnt.c_str(), nullptr);
+
+        if( canonical == nullptr )
+            throw std::runtime_error("failed to resolve path");
+
+        std::shared_ptr<mount_table> table(new mount_table);
+        table->parse_mountinfo("30 22 0:50 / " + std::string(canonical) + " rw - proc proc rw\n");
+        ::free(canonical);
+
+        directory_reader dr;
+        dr.recursive_ = dr.list_directories_ = true;
+        dr.mounts_ = table;
+
+        bool descended = false;
+
+        dr.manipulator_ = [&] {
+            if( dr.name_ == CPPX_U("sub") )
+                descended = true;
+        };
+
+        dr.read(link);
+
+        if( descended )
+            throw std::runtime_error("bad mount point lookup under symlinked root");
+#endif
+	}
+    catch (const std::exception & e) {
+        std::cerr << e.what() << std::endl;
+        fail = true;
+    }
+    catch (...) {
+		fail = true;
+	}
+
+    std::cerr << "mounts test " << (fail ? "failed" : "passed") << std::endl;
+}
+//------------------------------------------------------------------------------
+} // namespace tests
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
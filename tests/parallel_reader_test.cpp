@@ -0,0 +1,82 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+#include <iostream>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+//------------------------------------------------------------------------------
+#include "parallel_reader.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+namespace tests {
+//------------------------------------------------------------------------------
+void parallel_reader_test()
+{
+	bool fail = false;
+
+	try {
+        std::vector<std::pair<string, uintptr_t>> lst1, lst2;
+
+		directory_reader dr;
+
+        dr.recursive_ = dr.list_directories_ = true;
+        dr.manipulator_ = [&] {
+            lst1.emplace_back(std::make_pair(dr.path_name_, dr.level_));
+		};
+
+        dr.read(get_cwd());
+
+        parallel_directory_reader pdr;
+        std::mutex mtx;
+
+        pdr.threads_ = 4;
+        pdr.prototype_.list_directories_ = true;
+        pdr.read(get_cwd(), [&] (directory_reader & dr) {
+            std::unique_lock<std::mutex> lk(mtx);
+            lst2.emplace_back(std::make_pair(dr.path_name_, dr.level_));
+        });
+
+        std::sort(lst1.begin(), lst1.end());
+        std::sort(lst2.begin(), lst2.end());
+
+        if( lst1 != lst2 )
+            throw std::runtime_error("bad parallel directory reader implementation");
+	}
+    catch (const std::exception & e) {
+        std::cerr << e.what() << std::endl;
+        fail = true;
+    }
+    catch (...) {
+		fail = true;
+	}
+
+    std::cerr << "parallel reader test " << (fail ? "failed" : "passed") << std::endl;
+}
+//------------------------------------------------------------------------------
+} // namespace tests
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
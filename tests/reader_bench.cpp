@@ -0,0 +1,86 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+#include <iostream>
+#include <chrono>
+//------------------------------------------------------------------------------
+#include "indexer.hpp"
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+namespace tests {
+//------------------------------------------------------------------------------
+void reader_bench()
+{
+    // runs only if SPACENET_BENCH_DIR selects the tree, for cold cache
+    // numbers drop page cache (echo 3 > /proc/sys/vm/drop_caches) before
+    // each run
+    auto env = getenv(CPPX_U("SPACENET_BENCH_DIR"));
+
+    if( env == nullptr )
+        return;
+
+    string root(env);
+
+    auto bench = [&] (const char * title, const auto & setup) {
+        directory_reader dr;
+        uintptr_t entries = 0;
+
+        dr.recursive_ = dr.list_directories_ = true;
+        dr.manipulator_ = [&] {
+            entries++;
+        };
+
+        setup(dr);
+
+        try {
+            auto start = std::chrono::steady_clock::now();
+            dr.read(root);
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+
+            std::cerr << "reader bench " << title << ": " << entries << " entries, "
+                << elapsed << " us" << std::endl;
+        }
+        catch (const std::exception & e) {
+            std::cerr << "reader bench " << title << " failed, " << e.what() << std::endl;
+        }
+    };
+
+#if __linux__
+    bench("path", [] (auto & dr) { dr.fd_relative_ = false; });
+    bench("openat/statx", [] (auto &) {});
+#if HAVE_IO_URING && HAVE_STATX
+    bench("io_uring depth 32", [] (auto & dr) { dr.uring_depth_ = 32; });
+    bench("io_uring depth 256", [] (auto & dr) { dr.uring_depth_ = 256; });
+#endif
+#else
+    bench("sync", [] (auto &) {});
+#endif
+}
+//------------------------------------------------------------------------------
+} // namespace tests
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
@@ -0,0 +1,110 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Guram Duka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+#include <iostream>
+#include <fstream>
+//------------------------------------------------------------------------------
+#include "watcher.hpp"
+//------------------------------------------------------------------------------
+#if HAVE_INOTIFY
+//------------------------------------------------------------------------------
+#include <unistd.h>
+//------------------------------------------------------------------------------
+namespace spacenet {
+//------------------------------------------------------------------------------
+namespace tests {
+//------------------------------------------------------------------------------
+void watcher_test()
+{
+	bool fail = false;
+
+    string root = temp_name();
+    string sub = root + path_delimiter + CPPX_U("sub");
+    string file = sub + path_delimiter + CPPX_U("file");
+
+	try {
+        mkdir(root);
+
+        directory_watcher watcher(root);
+        std::unordered_set<string> dirty;
+
+        auto settle = [&] {
+            dirty.clear();
+            while( watcher.wait(200, dirty) );
+        };
+
+        mkdir(sub);
+        settle();
+
+        if( dirty.find(root) == dirty.cend() )
+            throw std::runtime_error("directory watcher missed subdirectory creation");
+
+        // watch of new subdirectory is added on its creation event
+        std::ofstream(file) << "content";
+        settle();
+
+        if( dirty.find(sub) == dirty.cend() || dirty.find(root) != dirty.cend() )
+            throw std::runtime_error("directory watcher missed file creation");
+
+        // write to file which stays open is reported before it is closed
+        {
+            std::ofstream f(file, std::ios::app);
+            settle();
+            f << "more" << std::flush;
+            settle();
+
+            if( dirty.find(sub) == dirty.cend() )
+                throw std::runtime_error("directory watcher missed file modification");
+        }
+        settle();
+
+        ::unlink(file.c_str());
+        ::rmdir(sub.c_str());
+        settle();
+
+        if( dirty.find(root) == dirty.cend() )
+            throw std::runtime_error("directory watcher missed subdirectory removal");
+	}
+    catch (const std::exception & e) {
+        std::cerr << e.what() << std::endl;
+        fail = true;
+    }
+    catch (...) {
+		fail = true;
+	}
+
+    ::unlink(file.c_str());
+    ::rmdir(sub.c_str());
+    ::rmdir(root.c_str());
+
+    std::cerr << "watcher test " << (fail ? "failed" : "passed") << std::endl;
+}
+//------------------------------------------------------------------------------
+} // namespace tests
+//------------------------------------------------------------------------------
+} // namespace spacenet
+//------------------------------------------------------------------------------
+#endif // HAVE_INOTIFY
+//------------------------------------------------------------------------------